@@ -0,0 +1,229 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cinttypes>
+#include <cstddef>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+
+// links of an intrusive list node, derive the node struct from ListHook<Node>
+// links belong to the position in the list, not to the value: copying or assigning a node keeps them untouched
+template <typename T>
+struct ListHook {
+	T *prev; // towards the front
+	T *next; // towards the back
+	ListHook() : prev(NULL), next(NULL) {}
+	ListHook(const ListHook &) : prev(NULL), next(NULL) {}
+	ListHook &operator=(const ListHook &) { return *this; }
+};
+
+// intrusive doubly-linked list over nodes owned by a NodeArena, mirrors the part of std::list the simulator uses
+// the list never allocates or frees: nodes are handed in by push and handed back by pop
+template <typename T>
+class NodeList {
+public:
+	NodeList() : head(NULL), tail(NULL), count(0) {}
+	T *front() const { return head; }
+	T *back() const { return tail; }
+	uint64_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	void push_front(T *node) {
+		node->prev = NULL;
+		node->next = head;
+		if (head) head->prev = node;
+		else tail = node;
+		head = node;
+		++count;
+	}
+	void push_back(T *node) {
+		node->next = NULL;
+		node->prev = tail;
+		if (tail) tail->next = node;
+		else head = node;
+		tail = node;
+		++count;
+	}
+	// unlink node from the list, the caller owns it afterwards
+	void erase(T *node) {
+		if (node->prev) node->prev->next = node->next;
+		else head = node->next;
+		if (node->next) node->next->prev = node->prev;
+		else tail = node->prev;
+		--count;
+	}
+	T *pop_front() { T *node = head; erase(node); return node; }
+	T *pop_back() { T *node = tail; erase(node); return node; }
+	// equivalent of list.splice(list.begin(), list, node)
+	void move_to_front(T *node) {
+		if (node == head) return;
+		erase(node);
+		push_front(node);
+	}
+private:
+	T *head, *tail;
+	uint64_t count;
+};
+
+// arena for fixed-size simulator nodes
+// storage is carved from a few large blocks and recycled through a free list, so the steady state never touches
+// the global allocator; reset() drops every node in O(1) and keeps the blocks for the next configuration
+template <typename T>
+class NodeArena {
+public:
+	NodeArena() : capacity(0), block(0), used(0) {}
+	~NodeArena() {
+		for (size_t i = 0; i != blocks.size(); ++i) delete[] blocks[i].nodes;
+	}
+	// make sure n nodes can be allocated after a reset without growing
+	void reserve(size_t n) {
+		if (n > capacity) addBlock(n - capacity);
+		if (free_nodes.capacity() < capacity) free_nodes.reserve(capacity);
+	}
+	T *alloc() {
+		if (!free_nodes.empty()) {
+			T *node = free_nodes.back();
+			free_nodes.pop_back();
+			return node;
+		}
+		// bump allocation, move on to the next block (or grow) when the current one is used up
+		while (block == blocks.size() || used == blocks[block].size) {
+			if (block == blocks.size()) addBlock(capacity ? capacity : 64);
+			else {
+				++block;
+				used = 0;
+			}
+		}
+		return &blocks[block].nodes[used++];
+	}
+	void free(T *node) { free_nodes.push_back(node); }
+	// release all nodes at once, nodes still linked anywhere must not be used afterwards
+	void reset() {
+		block = 0;
+		used = 0;
+		free_nodes.clear();
+	}
+private:
+	NodeArena(const NodeArena &);
+	NodeArena &operator=(const NodeArena &);
+	struct Block {
+		T *nodes;
+		size_t size;
+	};
+	void addBlock(size_t n) {
+		Block blk = { new T[n], n };
+		blocks.push_back(blk);
+		capacity += n;
+		free_nodes.reserve(capacity);
+	}
+	vector<Block> blocks;
+	size_t capacity; // total # nodes over all blocks
+	size_t block, used; // bump pointer: current block and # nodes taken from it
+	vector<T *> free_nodes;
+};
+
+// array of simulator state materialized one page at a time on first access
+// memory grows with the part of the index space a trace touches instead of the nominal size, which keeps sets of
+// large last-level caches affordable; find() peeks without materializing anything
+// the page directory is a plain array up to MAX_DENSE_PAGES pages, past that a hash map holding only the pages
+// touched, so a cache of 2 ^ 54 sets costs no more than the trace it runs
+// assign() only starts a new epoch, a page left over from an earlier epoch is cleared when it is touched again, so
+// reconfiguring costs nothing per materialized page
+template <typename T>
+class LazyArray {
+public:
+	LazyArray() : count(0), epoch(0), sparse(false) {}
+	~LazyArray() {
+		for (size_t i = 0; i != dense_pages.size(); ++i) delete[] dense_pages[i].data;
+		for (typename SparseDirectory::iterator it = sparse_pages.begin(); it != sparse_pages.end(); ++it)
+			delete[] it->second.data;
+	}
+	// n default elements, materialized pages are kept for reuse
+	void assign(uint64_t n) {
+		count = n;
+		const uint64_t npages = (n + PAGE_MASK) >> PAGE_BITS;
+		// free the pages past the new size
+		for (size_t i = (size_t)std::min<uint64_t>(npages, dense_pages.size()); i < dense_pages.size(); ++i)
+			delete[] dense_pages[i].data;
+		for (typename SparseDirectory::iterator it = sparse_pages.begin(); it != sparse_pages.end();) {
+			if (it->first < npages) ++it;
+			else {
+				delete[] it->second.data;
+				it = sparse_pages.erase(it);
+			}
+		}
+		// move the rest to the directory the new size uses
+		if (npages > MAX_DENSE_PAGES) {
+			for (size_t i = 0; i < dense_pages.size() && i < npages; ++i)
+				if (dense_pages[i].data) sparse_pages[i] = dense_pages[i];
+			vector<Page>().swap(dense_pages);
+			sparse = true;
+		}
+		else {
+			dense_pages.resize((size_t)npages);
+			for (typename SparseDirectory::iterator it = sparse_pages.begin(); it != sparse_pages.end(); ++it)
+				dense_pages[(size_t)it->first] = it->second;
+			sparse_pages.clear();
+			sparse = false;
+		}
+		// a wrapped epoch could pass a stale page off as current
+		if (++epoch == 0) {
+			for (size_t i = 0; i != dense_pages.size(); ++i) clear(dense_pages[i]);
+			for (typename SparseDirectory::iterator it = sparse_pages.begin(); it != sparse_pages.end(); ++it)
+				clear(it->second);
+			++epoch;
+		}
+	}
+	T &operator[](uint64_t i) {
+		const uint64_t p = i >> PAGE_BITS;
+		Page &page = sparse ? sparse_pages[p] : dense_pages[(size_t)p];
+		if (!page.data) {
+			page.data = new T[PAGE_SIZE];
+			page.epoch = epoch;
+		}
+		else if (page.epoch != epoch) {
+			clear(page);
+		}
+		return page.data[i & PAGE_MASK];
+	}
+	T *find(uint64_t i) const {
+		const uint64_t p = i >> PAGE_BITS;
+		const Page *page;
+		if (sparse) {
+			typename SparseDirectory::const_iterator it = sparse_pages.find(p);
+			if (it == sparse_pages.end()) return NULL;
+			page = &it->second;
+		}
+		else page = &dense_pages[(size_t)p];
+		return page->data && page->epoch == epoch ? &page->data[i & PAGE_MASK] : NULL;
+	}
+	uint64_t size() const { return count; }
+private:
+	LazyArray(const LazyArray &);
+	LazyArray &operator=(const LazyArray &);
+	static const uint64_t PAGE_BITS = 12;
+	static const uint64_t PAGE_SIZE = 1ULL << PAGE_BITS; // elements per page
+	static const uint64_t PAGE_MASK = PAGE_SIZE - 1;
+	static const uint64_t MAX_DENSE_PAGES = 1 << 16; // 1 MB of directory, 2 ^ 28 elements
+	struct Page {
+		T *data; // NULL until touched
+		uint32_t epoch; // epoch in which the page was last cleared
+		Page() : data(NULL), epoch(0) {}
+	};
+	typedef std::unordered_map<uint64_t, Page> SparseDirectory;
+	void clear(Page &page) {
+		if (!page.data) return;
+		for (uint64_t j = 0; j != PAGE_SIZE; ++j) page.data[j] = T();
+		page.epoch = epoch;
+	}
+	vector<Page> dense_pages; // page directory of an array up to MAX_DENSE_PAGES pages
+	SparseDirectory sparse_pages; // materialized pages of a larger array
+	uint64_t count;
+	uint32_t epoch; // bumped by assign()
+	bool sparse; // pages live in sparse_pages
+};
+
+#endif /* ARENA_HPP */
@@ -0,0 +1,115 @@
+#include "batch.hpp"
+
+#include <thread>
+
+BatchSim::BatchSim(const vector<string> &traces, const vector<batch_config_t> &configs, size_t threads,
+	size_t chunk_size, bool collapse) : configs(configs), threads(threads ? threads : 1), chunk_size(chunk_size),
+	collapse(collapse), run_shift(64), traces(traces.size()), active(0) {
+	// a run of blocks at the smallest block size is a run at every block size
+	for (size_t i = 0; i != configs.size(); ++i)
+		if (configs[i].b < run_shift) run_shift = configs[i].b;
+	for (size_t t = 0; t != traces.size(); ++t) {
+		Trace &trace = this->traces[t];
+		trace.name = traces[t];
+		trace.fin = NULL;
+		trace.pending = 0;
+		trace.chunk.reserve(chunk_size);
+		trace.stats.resize(configs.size()); // value-initialized, all counts zero
+		for (size_t i = 0; i != configs.size(); ++i) {
+			const batch_config_t &config = configs[i];
+			trace.caches.push_back(new_cache_engine(config.c, config.b, config.s, config.v, config.k));
+		}
+	}
+}
+
+BatchSim::~BatchSim() {
+	for (size_t t = 0; t != traces.size(); ++t) {
+		for (size_t i = 0; i != traces[t].caches.size(); ++i) delete traces[t].caches[i];
+		if (traces[t].fin) fclose(traces[t].fin);
+	}
+}
+
+bool BatchSim::run() {
+	for (size_t t = 0; t != traces.size(); ++t) {
+		traces[t].fin = fopen(traces[t].name.c_str(), "r");
+		if (!traces[t].fin) return false;
+	}
+	if (configs.empty()) return true;
+
+	active = traces.size();
+	for (size_t t = 0; t != traces.size(); ++t) schedule(t);
+
+	vector<std::thread> workers;
+	for (size_t i = 1; i < threads; ++i) workers.push_back(std::thread(&BatchSim::worker, this));
+	worker();
+	for (size_t i = 0; i != workers.size(); ++i) workers[i].join();
+
+	for (size_t t = 0; t != traces.size(); ++t)
+		for (size_t i = 0; i != configs.size(); ++i)
+			compute_statistics(configs[i].b, configs[i].s, &traces[t].stats[i]);
+	return true;
+}
+
+bool BatchSim::readChunk(Trace &trace) {
+	trace.chunk.clear();
+	Record record;
+	record.count = 1;
+	while (trace.chunk.size() != chunk_size && !feof(trace.fin)) {
+		int ret = fscanf(trace.fin, "%c %" PRIx64 "\n", &record.rw, &record.address);
+		if (ret != 2) continue;
+		// runs end at chunk boundaries
+		if (collapse && !trace.chunk.empty()) {
+			Record &last = trace.chunk.back();
+			if (last.rw == record.rw && (last.address >> run_shift) == (record.address >> run_shift)) {
+				++last.count;
+				continue;
+			}
+		}
+		trace.chunk.push_back(record);
+	}
+	return !trace.chunk.empty();
+}
+
+void BatchSim::schedule(size_t t) {
+	Trace &trace = traces[t];
+	bool more = readChunk(trace);
+	std::lock_guard<std::mutex> lock(mutex);
+	if (more) {
+		trace.pending = configs.size();
+		for (size_t i = 0; i != configs.size(); ++i) {
+			Job job = { t, i };
+			jobs.push_back(job);
+		}
+	}
+	else {
+		--active;
+	}
+	cv.notify_all();
+}
+
+void BatchSim::worker() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (jobs.empty() && active) cv.wait(lock);
+			if (jobs.empty()) return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		Trace &trace = traces[job.trace];
+		CacheEngine *cache = trace.caches[job.config];
+		cache_stats_t *p_stats = &trace.stats[job.config];
+		for (size_t i = 0; i != trace.chunk.size(); ++i)
+			engine_access_run(cache, trace.chunk[i].rw, trace.chunk[i].address, trace.chunk[i].count, p_stats);
+
+		// the last job on a chunk moves the trace on
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --trace.pending == 0;
+		}
+		if (last) schedule(job.trace);
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cachesim.hpp"
+
+using std::deque;
+using std::string;
+using std::vector;
+
+// one cache configuration of a batch
+struct batch_config_t {
+	uint64_t c, b, s, v, k;
+};
+
+// batch simulation: every configuration against every trace, on a pool of threads
+// each trace is parsed from disk once, a chunk of records at a time; every (trace, configuration) pair is a job
+// that runs its own cache over the chunk, and the last job to finish a chunk reads the next one and schedules the
+// jobs again. Different traces proceed independently, so the pool stays busy across the whole suite.
+// with collapse set, runs of same-type accesses to one block (at the smallest B of all configurations) are read as
+// a single weighted record
+class BatchSim {
+public:
+	BatchSim(const vector<string> &traces, const vector<batch_config_t> &configs, size_t threads, size_t chunk_size,
+		bool collapse);
+	~BatchSim();
+	bool run(); // simulate everything, false if a trace cannot be opened
+	cache_stats_t *getStats(size_t trace, size_t config) { return &traces[trace].stats[config]; }
+private:
+	BatchSim(const BatchSim &);
+	BatchSim &operator=(const BatchSim &);
+
+	struct Record {
+		char rw;
+		uint64_t address;
+		uint64_t count; // # events in the run
+	};
+	// struct for one trace: its file, the chunk being simulated and one cache per configuration
+	struct Trace {
+		string name;
+		FILE *fin;
+		vector<Record> chunk;
+		size_t pending; // jobs still working on the chunk
+		vector<CacheEngine *> caches;
+		vector<cache_stats_t> stats;
+	};
+	// job: run one configuration over the current chunk of one trace
+	struct Job {
+		size_t trace, config;
+	};
+
+	void worker();
+	bool readChunk(Trace &trace); // false at the end of the trace
+	void schedule(size_t trace); // read the next chunk and queue its jobs, or retire the trace (caller holds no lock)
+
+	vector<batch_config_t> configs;
+	size_t threads;
+	size_t chunk_size;
+	bool collapse;
+	uint64_t run_shift; // runs are formed on address >> run_shift
+	vector<Trace> traces;
+	std::mutex mutex;
+	std::condition_variable cv;
+	deque<Job> jobs;
+	size_t active; // traces not finished yet
+};
+
+static const size_t DEFAULT_CHUNK = 1 << 16;	/* records per trace chunk */
+
+#endif /* BATCH_HPP */
@@ -1,19 +1,71 @@
 #include "cachesim.hpp"
+#include "memmodel.hpp"
+#include "writebuffer.hpp"
+#include "profile.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include <algorithm>
+
+void CacheEngine::configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	this->c = c;
+	this->b = b;
+	this->s = s;
+	this->v = v;
+	this->k = k;
+	// # blocks per set: 2 ^ s -> set capacity
+	set_capacity = 1ULL << s;
+	// # sets: 2 ^ (c - b - s)
+	idx_mask = (1ULL << (c - b - s)) - 1;
+	// prefetcher variables initialized to zero
+	last_miss = 0;
+	pending_stride = 0;
+	stride_sign = true;
+}
+
+// drop all blocks in O(1) and size the arenas so that no allocation happens while simulating a cache of up to
+// EAGER_BLOCKS blocks, larger caches allocate nodes as the trace fills them
+void CacheSim::configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	CacheEngine::configure(c, b, s, v, k);
+	l1Nodes.reset();
+	vcNodes.reset();
+	// total # blocks: 2 ^ (c - b)
+	l1Nodes.reserve((size_t)std::min<uint64_t>(1ULL << (c - b), EAGER_BLOCKS));
+	vcNodes.reserve(v);
+	// # sets: 2 ^ (c - b - s), assign() keeps the pages already materialized
+	cacheSets.assign(idx_mask + 1);
+	victimCache = NodeList<VCNode>();
+	last_node = NULL;
+}
 
 // implementation of cache access funciton
 cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 	cache_access_t result;
+
+	// same block as the last access and still MRU: a hit that can only set the dirty bit
+	// the prefetcher only triggers on misses, so it is left alone as well
+	if (last_node && (address >> b) == last_block) {
+		PROFILE_FAST_HIT();
+		if (rw == WRITE && write_back) last_node->dirty = DIRTY;
+		return result;
+	}
 	
 	// address decoder
 	const uint64_t addrTag = address >> (c - s);
-	const unsigned int addrIdx = ((address >> b) & ((1 << (c - s - b)) - 1));
+	const uint64_t addrIdx = (address >> b) & idx_mask;
 
 	// probe the L1 cache
-	list<CacheNode>::iterator l1beg = cacheSets[addrIdx].begin(); // iterator in L1 cache set
-	while (l1beg != cacheSets[addrIdx].end() && l1beg->tag != addrTag) ++l1beg;
+	CacheNode *l1beg = cacheSets[addrIdx].front(); // iterator in L1 cache set
+	PROFILE_COUNTER(l1Probes);
+	while (l1beg && l1beg->tag != addrTag) {
+		PROFILE_COUNT(l1Probes);
+		l1beg = l1beg->next;
+	}
+	PROFILE_PROBE(PROBE_L1, l1Probes + (l1beg != NULL));
 
 	// hit on block in L1 cache
-	if (l1beg != cacheSets[addrIdx].end()) {
+	if (l1beg) {
 		// check whether it's the first hit on a prefetched block
 		if (l1beg->isPrefetch == PREFETCH) {
 			// update useful prefetch count and reset prefetch bit
@@ -21,7 +73,7 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 			l1beg->isPrefetch = NONPREFETCH;
 		}
 		// promote to MRU position on hit
-		cacheSets[addrIdx].splice(cacheSets[addrIdx].begin(), cacheSets[addrIdx], l1beg);
+		cacheSets[addrIdx].move_to_front(l1beg);
 	}
 
 	// miss in L1, vc disabled: fetch from main memory, insert as MRU and evict the LRU block when cache set is full
@@ -29,13 +81,19 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 		// update miss count and vc miss count
 		++result.misses;
 		++result.vc_misses;
-		// evict LRU block when L1 cache set is full, check dirty bit and update writeback count
-		if (cacheSets[addrIdx].size() == set_capacity) {
-			if (cacheSets[addrIdx].back().dirty) ++result.writebacks;
-			cacheSets[addrIdx].pop_back();
+		// no-write-allocate: the store goes around the cache
+		if (rw == WRITE && !write_allocate) {
+			++result.write_bypasses;
+		}
+		else {
+			// evict LRU block when L1 cache set is full, check dirty bit and update writeback count
+			if (cacheSets[addrIdx].size() == set_capacity) {
+				if (cacheSets[addrIdx].back()->dirty) ++result.writebacks;
+				l1Nodes.free(cacheSets[addrIdx].pop_back());
+			}
+			// fetch block from main memory and insert at the MRU position of L1 cache set
+			cacheSets[addrIdx].push_front(newNode(CacheNode(addrTag)));
 		}
-		// fetch block from main memory and insert at the MRU position of L1 cache set
-		cacheSets[addrIdx].push_front(CacheNode(addrTag));
 	}
 
 	// ========== victim cache implementation ===============
@@ -44,48 +102,64 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 	else {
 		// update miss count
 		++result.misses;
-		list<VCNode>::iterator vcbeg = victimCache.begin(); // iterator in vimtim cache
-		while (vcbeg != victimCache.end() && (vcbeg->idx != addrIdx || vcbeg->tag != addrTag)) ++vcbeg;
+		VCNode *vcbeg = victimCache.front(); // iterator in vimtim cache
+		PROFILE_COUNTER(vcProbes);
+		while (vcbeg && (vcbeg->idx != addrIdx || vcbeg->tag != addrTag)) {
+			PROFILE_COUNT(vcProbes);
+			vcbeg = vcbeg->next;
+		}
+		PROFILE_PROBE(PROBE_VC, vcProbes + (vcbeg != NULL));
 
 		// hit on block in VC, swap it with the LRU block from corresponding L1 cache set and promote to MRU position
-		if (vcbeg != victimCache.end()) {
+		if (vcbeg) {
 			// check whether its a prefetch block in VC
 			if (vcbeg->isPrefetch) {
 				++result.useful_prefetches;
 				vcbeg->isPrefetch = false;
 			}
 			// swap hit block in vc with LRU block in L1 and then make it MRU
-			// cacheSets[addrIdx] must be full, otherwise the hit block wouldn't be found in vc
+			// cacheSets[addrIdx] is full unless a coherence invalidation made room in it
 			VCNode temp = *vcbeg;
-			// move the LRU block in L1 cache to VC
-			*vcbeg = VCNode(cacheSets[addrIdx].back(), addrIdx);
-			cacheSets[addrIdx].pop_back();
+			if (cacheSets[addrIdx].size() == set_capacity) {
+				// move the LRU block in L1 cache to VC
+				*vcbeg = VCNode(*cacheSets[addrIdx].back(), addrIdx);
+				l1Nodes.free(cacheSets[addrIdx].pop_back());
+			}
+			else {
+				victimCache.erase(vcbeg);
+				vcNodes.free(vcbeg);
+			}
 			// insert the hit block in VC to L1 cache at the MRU position
-			cacheSets[addrIdx].push_front(CacheNode(temp.tag, temp.dirty, NONPREFETCH));
+			cacheSets[addrIdx].push_front(newNode(CacheNode(temp.tag, temp.dirty, NONPREFETCH)));
 		}
 
 		// miss in VC, fetch the block from main memory and insert into L1 cache, update VC correspondingly
 		else {
 			// update vc miss count
 			++result.vc_misses;
-			if (cacheSets[addrIdx].size() == set_capacity) {
+			// no-write-allocate: the store goes around the cache
+			if (rw == WRITE && !write_allocate) {
+				++result.write_bypasses;
+			}
+			else if (cacheSets[addrIdx].size() == set_capacity) {
 				// evict the oldest block when VC is full, check dirty bit and update writeback count
 				if (victimCache.size() == v) {
-					if (victimCache.front().dirty) ++result.writebacks;
-					victimCache.pop_front();
+					if (victimCache.front()->dirty) ++result.writebacks;
+					vcNodes.free(victimCache.pop_front());
 				}
 				// move LRU block from L1 to VC when L1 cache set is full
-				victimCache.push_back(VCNode(cacheSets[addrIdx].back(), addrIdx));
-				cacheSets[addrIdx].pop_back();
+				victimCache.push_back(newNode(VCNode(*cacheSets[addrIdx].back(), addrIdx)));
+				l1Nodes.free(cacheSets[addrIdx].pop_back());
 			}
 			// fetch block from main memory and insert at MRU position of L1 cache set
-			cacheSets[addrIdx].push_front(CacheNode(addrTag));
+			if (!result.write_bypasses) cacheSets[addrIdx].push_front(newNode(CacheNode(addrTag)));
 		}
 	}
 	// ========== end of victim cache implementation ===============
 
 	// set dirty bit per write access (the accessed block will be in the MRU position)
-	if (rw == WRITE) cacheSets[addrIdx].front().dirty = DIRTY;
+	// write-through caches never hold dirty blocks, bypassed writes left nothing in the cache
+	if (rw == WRITE && write_back && !result.write_bypasses) cacheSets[addrIdx].front()->dirty = DIRTY;
 
 
 
@@ -101,51 +175,70 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 		if (d_sign == stride_sign && d == pending_stride) {
 			// update prefetch blocks count
 			result.prefetch_blocks += k;
+			result.prefetch_stride = d_sign ? (int64_t)d : -(int64_t)d;
 			// initialize prefetch address, index and tag (prefetch address is set to the miss block address)
 			uint64_t prefetch_addr = (address >> b); // block address with offset bits discarded
 			uint64_t prefetch_tag;
-			unsigned int prefetch_index;
+			uint64_t prefetch_index;
 
 			// prefetch K blocks
-			for (int i = 0; i != k; ++i) {
+			for (uint64_t i = 0; i != k; ++i) {
 				// calculate prefetch address, index and tag
 				if (d_sign)
 					prefetch_addr += d;
 				else
 					prefetch_addr -= d;
-				prefetch_index = (prefetch_addr & ((1 << (c - s - b)) - 1));
+				prefetch_index = prefetch_addr & idx_mask;
 				prefetch_tag = prefetch_addr >> (c - s - b);
 
 				// check whether it already exists in the cache
-				list<CacheNode>::iterator prefbeg = cacheSets[prefetch_index].begin();
-				while (prefbeg != cacheSets[prefetch_index].end() && prefbeg->tag != prefetch_tag) ++prefbeg;
+				CacheNode *prefbeg = cacheSets[prefetch_index].front();
+				PROFILE_COUNTER(prefProbes);
+				while (prefbeg && prefbeg->tag != prefetch_tag) {
+					PROFILE_COUNT(prefProbes);
+					prefbeg = prefbeg->next;
+				}
+				PROFILE_PROBE(PROBE_PREFETCH_L1, prefProbes + (prefbeg != NULL));
 
 				// if the block is already in L1 cache, don't do anything
 
 				// if the block is not in L1, check whether it's in VC, or prefetch when VC is disabled
-				if (prefbeg == cacheSets[prefetch_index].end()) {
+				if (!prefbeg) {
 
 					// vc disabled: evict LRU block when cache set is full, then prefetch into LRU position in L1 cache set
 					if (!v) {
 						if (cacheSets[prefetch_index].size() == set_capacity) {
-							if (cacheSets[prefetch_index].back().dirty)
+							if (cacheSets[prefetch_index].back()->dirty)
 								++result.writebacks;
-							cacheSets[prefetch_index].pop_back();
+							l1Nodes.free(cacheSets[prefetch_index].pop_back());
 						}
-						cacheSets[prefetch_index].push_back(CacheNode(prefetch_tag, CLEAN, PREFETCH));
+						cacheSets[prefetch_index].push_back(newNode(CacheNode(prefetch_tag, CLEAN, PREFETCH)));
+						if (prefetch_log) prefetch_log->push_back(prefetch_addr);
 					}
 
 					// VC enabled: check whether the block is already in VC
 					else {
-						list<VCNode>::iterator prefvcbeg = victimCache.begin();
-						while (prefvcbeg != victimCache.end() && (prefvcbeg->idx != prefetch_index || prefvcbeg->tag != prefetch_tag))
-							++prefvcbeg;
+						VCNode *prefvcbeg = victimCache.front();
+						PROFILE_COUNTER(prefVCProbes);
+						while (prefvcbeg && (prefvcbeg->idx != prefetch_index || prefvcbeg->tag != prefetch_tag)) {
+							PROFILE_COUNT(prefVCProbes);
+							prefvcbeg = prefvcbeg->next;
+						}
+						PROFILE_PROBE(PROBE_PREFETCH_VC, prefVCProbes + (prefvcbeg != NULL));
 						// if the block is in VC, swap it with the LRU block in L1 cache set and set prefetch bit
-						if (prefvcbeg != victimCache.end()) {
+						if (prefvcbeg) {
 							VCNode temp = *prefvcbeg;
-							*prefvcbeg = VCNode(cacheSets[prefetch_index].back(), prefetch_index);
 							// preserve dirty bit and set prefetch bit to true when insert into L1 cache
-							cacheSets[prefetch_index].back() = CacheNode(temp.tag, temp.dirty, PREFETCH);
+							if (cacheSets[prefetch_index].size() == set_capacity) {
+								*prefvcbeg = VCNode(*cacheSets[prefetch_index].back(), prefetch_index);
+								*cacheSets[prefetch_index].back() = CacheNode(temp.tag, temp.dirty, PREFETCH);
+							}
+							// room left by a coherence invalidation: just move the block over
+							else {
+								victimCache.erase(prefvcbeg);
+								vcNodes.free(prefvcbeg);
+								cacheSets[prefetch_index].push_back(newNode(CacheNode(temp.tag, temp.dirty, PREFETCH)));
+							}
 						}
 
 						// if the block is not in VC, prefetch from main memory
@@ -155,15 +248,16 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 							if (cacheSets[prefetch_index].size() == set_capacity) {
 								// evict the oldest block when VC is full, check dirty bit and update writeback count
 								if (victimCache.size() == v) {
-									if (victimCache.front().dirty) ++result.writebacks;
-									victimCache.pop_front();
+									if (victimCache.front()->dirty) ++result.writebacks;
+									vcNodes.free(victimCache.pop_front());
 								}
 								// move the LRU block from L1 to VC when L1 cache set is full
-								victimCache.push_back(VCNode(cacheSets[prefetch_index].back(), prefetch_index));
-								cacheSets[prefetch_index].pop_back();
+								victimCache.push_back(newNode(VCNode(*cacheSets[prefetch_index].back(), prefetch_index)));
+								l1Nodes.free(cacheSets[prefetch_index].pop_back());
 							}
 							// prefetch from main memory and insert at the LRU position
-							cacheSets[prefetch_index].push_back(CacheNode(prefetch_tag, CLEAN, PREFETCH));
+							cacheSets[prefetch_index].push_back(newNode(CacheNode(prefetch_tag, CLEAN, PREFETCH)));
+							if (prefetch_log) prefetch_log->push_back(prefetch_addr);
 						}
 					}
 				}
@@ -177,11 +271,563 @@ cache_access_t CacheSim::cacheAccess(char rw, uint64_t address) {
 	}
 	// =============== end of prefetch implementation ===============
 
+	// remember the block for the fast path, unless the access bypassed the cache or a prefetch into a
+	// direct-mapped set pushed it out again; a block the prefetcher put in its place (no-write-allocate miss
+	// with stride 0) still has to count as a useful prefetch on its first hit, which the fast path would skip
+	last_block = address >> b;
+	last_node = cacheSets[addrIdx].front();
+	if (last_node && (last_node->tag != addrTag || last_node->isPrefetch)) last_node = NULL;
+
 	return result;
 }
 
-// Global object that simulates the cache
-CacheSim cacheSim;
+// probes do not materialize sets the trace never touched
+CacheSim::CacheNode *CacheSim::findBlock(uint64_t address) {
+	const uint64_t addrTag = address >> (c - s);
+	const NodeList<CacheNode> *set = cacheSets.find((address >> b) & idx_mask);
+	CacheNode *node = set ? set->front() : NULL;
+	while (node && node->tag != addrTag) node = node->next;
+	return node;
+}
+
+CacheSim::VCNode *CacheSim::findVictim(uint64_t address) {
+	const uint64_t addrTag = address >> (c - s);
+	const uint64_t addrIdx = (address >> b) & idx_mask;
+	VCNode *node = victimCache.front();
+	while (node && (node->idx != addrIdx || node->tag != addrTag)) node = node->next;
+	return node;
+}
+
+bool CacheSim::contains(uint64_t address) {
+	return findBlock(address) || findVictim(address);
+}
+
+bool CacheSim::invalidate(uint64_t address) {
+	const uint64_t addrIdx = (address >> b) & idx_mask;
+	bool dirty = CLEAN;
+	last_node = NULL;
+	if (CacheNode *node = findBlock(address)) {
+		dirty = node->dirty;
+		cacheSets[addrIdx].erase(node);
+		l1Nodes.free(node);
+	}
+	else if (VCNode *node = findVictim(address)) {
+		dirty = node->dirty;
+		victimCache.erase(node);
+		vcNodes.free(node);
+	}
+	return dirty;
+}
+
+bool CacheSim::clean(uint64_t address) {
+	bool dirty = CLEAN;
+	if (CacheNode *node = findBlock(address)) {
+		dirty = node->dirty;
+		node->dirty = CLEAN;
+	}
+	else if (VCNode *node = findVictim(address)) {
+		dirty = node->dirty;
+		node->dirty = CLEAN;
+	}
+	return dirty;
+}
+
+// ================== HashCacheSim ==================
+
+// VC entries are overwritten before use, so they only grow; sets, the slot pool and the hash table are cleared,
+// sets and hash table entries lazily
+void HashCacheSim::configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	CacheEngine::configure(c, b, s, v, k);
+	cacheSets.assign(idx_mask + 1);
+	// total # blocks: 2 ^ (c - b)
+	slots.clear();
+	free_slots.clear();
+	slots.reserve((size_t)std::min<uint64_t>(1ULL << (c - b), EAGER_BLOCKS));
+	// hash table starts with room for up to EAGER_BLOCKS blocks and doubles as it fills up,
+	// at 2 ^ (c - b + 1) entries it holds the whole cache and is never more than half full
+	// a table left from an earlier configuration is reused when it is big enough, a new epoch empties it
+	const uint64_t entries = 2 * std::min<uint64_t>(1ULL << (c - b), EAGER_BLOCKS);
+	table_used = 0;
+	if (++table_epoch == 0) {
+		for (size_t i = 0; i != table.size(); ++i) table[i].epoch = 0;
+		table_epoch = 1;
+	}
+	if (table.size() < entries) {
+		table.clear();
+		resizeTable(entries);
+	}
+	if (victimCache.size() < v) victimCache.resize(v);
+	vc_head = 0;
+	vc_size = 0;
+	last_slot = NIL;
+}
+
+void HashCacheSim::unlink(Set &set, uint32_t i) {
+	Slot &node = slots[i];
+	if (node.prev != NIL) slots[node.prev].next = node.next;
+	else set.head = node.next;
+	if (node.next != NIL) slots[node.next].prev = node.prev;
+	else set.tail = node.prev;
+	--set.size;
+}
+
+void HashCacheSim::pushFront(Set &set, uint32_t i) {
+	Slot &node = slots[i];
+	node.prev = NIL;
+	node.next = set.head;
+	if (set.head != NIL) slots[set.head].prev = i;
+	else set.tail = i;
+	set.head = i;
+	++set.size;
+}
+
+void HashCacheSim::pushBack(Set &set, uint32_t i) {
+	Slot &node = slots[i];
+	node.next = NIL;
+	node.prev = set.tail;
+	if (set.tail != NIL) slots[set.tail].next = i;
+	else set.head = i;
+	set.tail = i;
+	++set.size;
+}
+
+// slots are only taken while a set is filling up and are reused in place on eviction,
+// so the pool never holds more than 2 ^ (c - b) slots
+uint32_t HashCacheSim::allocSlot() {
+	if (!free_slots.empty()) {
+		uint32_t i = free_slots.back();
+		free_slots.pop_back();
+		return i;
+	}
+	slots.push_back(Slot());
+	return (uint32_t)(slots.size() - 1);
+}
+
+uint32_t HashCacheSim::find(uint64_t block, int probe) const {
+	uint64_t pos = hashPos(block);
+	PROFILE_COUNTER(length);
+	while (used(table[pos])) {
+		PROFILE_COUNT(length);
+		if (table[pos].block == block) {
+			PROFILE_PROBE(probe, length);
+			return table[pos].slot;
+		}
+		pos = (pos + 1) & hash_mask;
+	}
+	PROFILE_PROBE(probe, length);
+	return NIL;
+}
+
+void HashCacheSim::insert(uint64_t block, uint32_t slot) {
+	if (2 * ++table_used > table.size()) resizeTable(2 * table.size());
+	uint64_t pos = hashPos(block);
+	while (used(table[pos])) pos = (pos + 1) & hash_mask;
+	table[pos].block = block;
+	table[pos].slot = slot;
+	table[pos].epoch = table_epoch;
+}
+
+// backward shift deletion: no tombstones, so probe lengths never degrade
+void HashCacheSim::erase(uint64_t block) {
+	uint64_t i = hashPos(block);
+	while (table[i].block != block || !used(table[i])) i = (i + 1) & hash_mask;
+	uint64_t j = i;
+	while (true) {
+		j = (j + 1) & hash_mask;
+		if (!used(table[j])) break;
+		// move entry j into the hole unless its home position lies cyclically in (i, j]
+		uint64_t home = hashPos(table[j].block);
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i].epoch = 0;
+	--table_used;
+}
+
+void HashCacheSim::resizeTable(uint64_t entries) {
+	vector<HashEntry> old(entries, HashEntry());
+	old.swap(table);
+	hash_mask = entries - 1;
+	hash_shift = 64;
+	while (entries >>= 1) --hash_shift;
+	for (size_t i = 0; i != old.size(); ++i) {
+		if (!used(old[i])) continue;
+		uint64_t pos = hashPos(old[i].block);
+		while (used(table[pos])) pos = (pos + 1) & hash_mask;
+		table[pos] = old[i];
+	}
+}
+
+HashCacheSim::VCNode *HashCacheSim::vcFind(uint64_t block, int probe) {
+	for (uint64_t i = 0; i != vc_size; ++i) {
+		VCNode &node = victimCache[(vc_head + i) % v];
+		if (node.block == block) {
+			PROFILE_PROBE(probe, i + 1);
+			return &node;
+		}
+	}
+	PROFILE_PROBE(probe, vc_size);
+	return NULL;
+}
+
+void HashCacheSim::vcPush(const Slot &slot, cache_access_t &result) {
+	// evict the oldest block when VC is full, check dirty bit and update writeback count
+	if (vc_size == v) {
+		if (victimCache[vc_head].dirty) ++result.writebacks;
+		vc_head = (vc_head + 1) % v;
+		--vc_size;
+	}
+	victimCache[(vc_head + vc_size) % v] = VCNode(slot);
+	++vc_size;
+}
+
+// remove a block from the middle of the FIFO, younger blocks move up one position
+void HashCacheSim::vcErase(VCNode *node) {
+	uint64_t i = ((node - &victimCache[0]) + v - vc_head) % v;
+	for (; i + 1 < vc_size; ++i) victimCache[(vc_head + i) % v] = victimCache[(vc_head + i + 1) % v];
+	--vc_size;
+}
+
+uint32_t HashCacheSim::evictToVC(Set &set, cache_access_t &result) {
+	uint32_t i = set.tail;
+	vcPush(slots[i], result);
+	erase(slots[i].block);
+	unlink(set, i);
+	return i;
+}
+
+void HashCacheSim::removeSlot(Set &set, uint32_t i) {
+	erase(slots[i].block);
+	unlink(set, i);
+	free_slots.push_back(i);
+}
+
+bool HashCacheSim::contains(uint64_t address) {
+	return find(address >> b) != NIL || vcFind(address >> b);
+}
+
+bool HashCacheSim::invalidate(uint64_t address) {
+	const uint64_t addrBlock = address >> b;
+	bool dirty = CLEAN;
+	last_slot = NIL;
+	uint32_t i = find(addrBlock);
+	if (i != NIL) {
+		dirty = slots[i].dirty;
+		removeSlot(cacheSets[addrBlock & idx_mask], i);
+	}
+	else if (VCNode *node = vcFind(addrBlock)) {
+		dirty = node->dirty;
+		vcErase(node);
+	}
+	return dirty;
+}
+
+bool HashCacheSim::clean(uint64_t address) {
+	const uint64_t addrBlock = address >> b;
+	bool dirty = CLEAN;
+	uint32_t i = find(addrBlock);
+	if (i != NIL) {
+		dirty = slots[i].dirty;
+		slots[i].dirty = CLEAN;
+	}
+	else if (VCNode *node = vcFind(addrBlock)) {
+		dirty = node->dirty;
+		node->dirty = CLEAN;
+	}
+	return dirty;
+}
+
+// mirrors CacheSim::cacheAccess step by step, see the comments there
+cache_access_t HashCacheSim::cacheAccess(char rw, uint64_t address) {
+	cache_access_t result;
+
+	// address decoder
+	const uint64_t addrBlock = address >> b;
+
+	// same-block fast path
+	if (last_slot != NIL && addrBlock == last_block) {
+		PROFILE_FAST_HIT();
+		if (rw == WRITE && write_back) slots[last_slot].dirty = DIRTY;
+		return result;
+	}
+
+	Set &set = cacheSets[addrBlock & idx_mask];
+
+	// probe the L1 cache
+	uint32_t mru = find(addrBlock, PROBE_L1); // slot of the accessed block, MRU after the access (NIL if bypassed)
+
+	// hit on block in L1 cache
+	if (mru != NIL) {
+		if (slots[mru].isPrefetch == PREFETCH) {
+			++result.useful_prefetches;
+			slots[mru].isPrefetch = NONPREFETCH;
+		}
+		// promote to MRU position on hit
+		unlink(set, mru);
+		pushFront(set, mru);
+	}
+
+	else {
+		++result.misses;
+		VCNode *vcHit = v ? vcFind(addrBlock, PROBE_VC) : NULL;
+		bool dirty = CLEAN;
+
+		// hit on block in VC, swap it with the LRU block of the L1 cache set
+		if (vcHit) {
+			if (vcHit->isPrefetch) ++result.useful_prefetches;
+			VCNode temp = *vcHit;
+			if (set.size == set_capacity) {
+				mru = set.tail;
+				*vcHit = VCNode(slots[mru]);
+				erase(slots[mru].block);
+				unlink(set, mru);
+			}
+			// room left by a coherence invalidation: just take the block out of VC
+			else {
+				vcErase(vcHit);
+				mru = allocSlot();
+			}
+			dirty = temp.dirty;
+		}
+
+		// no-write-allocate: the store goes around the cache
+		else if (rw == WRITE && !write_allocate) {
+			++result.vc_misses;
+			++result.write_bypasses;
+		}
+
+		// miss in L1 (and VC): fetch from main memory, make room in the set first
+		else {
+			++result.vc_misses;
+			if (set.size != set_capacity) {
+				mru = allocSlot();
+			}
+			else if (v) {
+				mru = evictToVC(set, result);
+			}
+			else {
+				mru = set.tail;
+				if (slots[mru].dirty) ++result.writebacks;
+				erase(slots[mru].block);
+				unlink(set, mru);
+			}
+		}
+
+		// insert at the MRU position of L1 cache set
+		if (mru != NIL) {
+			slots[mru].block = addrBlock;
+			slots[mru].dirty = dirty;
+			slots[mru].isPrefetch = NONPREFETCH;
+			insert(addrBlock, mru);
+			pushFront(set, mru);
+		}
+	}
+
+	// set dirty bit per write access
+	if (rw == WRITE && write_back && mru != NIL) slots[mru].dirty = DIRTY;
+
+	// check prefetcher when there's an L1 miss (even it hits in vc)
+	if (k && result.misses) {
+		bool d_sign = addrBlock > last_miss;
+		uint64_t d = d_sign ? addrBlock - last_miss : last_miss - addrBlock;
+
+		if (d_sign == stride_sign && d == pending_stride) {
+			result.prefetch_blocks += k;
+			result.prefetch_stride = d_sign ? (int64_t)d : -(int64_t)d;
+			uint64_t prefetch_addr = addrBlock;
+
+			for (uint64_t i = 0; i != k; ++i) {
+				if (d_sign)
+					prefetch_addr += d;
+				else
+					prefetch_addr -= d;
+
+				// if the block is already in L1 cache, don't do anything
+				if (find(prefetch_addr, PROBE_PREFETCH_L1) != NIL) continue;
+
+				Set &pset = cacheSets[prefetch_addr & idx_mask];
+				VCNode *vcHit = v ? vcFind(prefetch_addr, PROBE_PREFETCH_VC) : NULL;
+				uint32_t lru;
+
+				// block is in VC: swap it with the LRU block in place, preserve dirty bit and set prefetch bit
+				if (vcHit && pset.size == set_capacity) {
+					VCNode temp = *vcHit;
+					lru = pset.tail;
+					*vcHit = VCNode(slots[lru]);
+					erase(slots[lru].block);
+					slots[lru].block = temp.block;
+					slots[lru].dirty = temp.dirty;
+					slots[lru].isPrefetch = PREFETCH;
+					insert(temp.block, lru);
+					continue;
+				}
+
+				// prefetch into the LRU position (from VC after a coherence invalidation, otherwise from main memory)
+				// make room in the set first
+				bool dirty = CLEAN;
+				if (vcHit) {
+					dirty = vcHit->dirty;
+					vcErase(vcHit);
+					lru = allocSlot();
+				}
+				else if (pset.size != set_capacity) {
+					lru = allocSlot();
+				}
+				else if (v) {
+					lru = evictToVC(pset, result);
+				}
+				else {
+					lru = pset.tail;
+					if (slots[lru].dirty) ++result.writebacks;
+					erase(slots[lru].block);
+					unlink(pset, lru);
+				}
+				slots[lru].block = prefetch_addr;
+				slots[lru].dirty = dirty;
+				slots[lru].isPrefetch = PREFETCH;
+				insert(prefetch_addr, lru);
+				pushBack(pset, lru);
+				if (!vcHit && prefetch_log) prefetch_log->push_back(prefetch_addr);
+			}
+		}
+
+		// update prefetcher variables
+		pending_stride = d;
+		stride_sign = d_sign;
+		last_miss = addrBlock;
+	}
+
+	// remember the block for the fast path if it is still MRU and not waiting for its first hit as a prefetch
+	last_block = addrBlock;
+	last_slot = set.head != NIL && slots[set.head].block == addrBlock && !slots[set.head].isPrefetch ? set.head : NIL;
+
+	return result;
+}
+
+// state of one simulation: the cache, the write buffer and the memory model behind it
+// a libcachesim handle points to one, the subroutines below drive the global one
+struct cachesim {
+	// one object per engine so that storage survives reconfiguration
+	CacheSim listSim;
+	HashCacheSim hashSim;
+	CacheEngine *engine;
+	// timing model of the memory back end, disabled unless setMemory enables it
+	MemModel memModel;
+	// blocks the prefetcher fetched in the current access, logged for the memory model only
+	vector<uint64_t> prefetched;
+	// write policy and the write buffer behind it, the buffer is unused with WRITE_BACK
+	write_policy_t writePolicy;
+	WriteBuffer writeBuffer;
+	// counts of the handle API, the subroutines keep theirs in the caller's statistics structure
+	cache_stats_t stats;
+	// a handle call ran out of memory midway, the handle refuses everything but a reset from then on
+	bool failed;
+
+	cachesim() : engine(&listSim), writePolicy(DEFAULT_W), failed(false) { memset(&stats, 0, sizeof(cache_stats_t)); }
+	void setup(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+	void setMemory(uint64_t mshrs, double bandwidth);
+	void setWritePolicy(write_policy_t policy, uint64_t entries, uint64_t drain_interval);
+	void access(char rw, uint64_t address, cache_stats_t *p_stats);
+	void accessRun(char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats);
+	void complete(cache_stats_t *p_stats) { finish(p_stats, writeBuffer, memModel); }
+	// statistics of the handle so far, the simulation goes on: drains copies of the write buffer and memory model
+	void snapshot(cache_stats_t *p_stats) const {
+		WriteBuffer buffer(writeBuffer);
+		MemModel model(memModel);
+		*p_stats = stats;
+		finish(p_stats, buffer, model);
+	}
+	void finish(cache_stats_t *p_stats, WriteBuffer &buffer, MemModel &model) const;
+};
+
+void cachesim::setup(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	// probing a highly associative set linearly costs O(2^s), switch to the hash-indexed engine
+	if (s >= HASH_ENGINE_MIN_S)
+		engine = &hashSim;
+	else
+		engine = &listSim;
+	engine->configure(c, b, s, v, k);
+	engine->setWritePolicy(writePolicy);
+	memModel.reset(b, 2 + 0.2 * s);
+	writeBuffer.reset(b);
+	writeBuffer.setAccessTime(memModel.enabled() ? memModel.getHitTime() : 1);
+}
+
+void cachesim::setMemory(uint64_t mshrs, double bandwidth) {
+	memModel.configure(mshrs, bandwidth);
+	// both engines, setup may switch between them later
+	vector<uint64_t> *log = memModel.enabled() ? &prefetched : NULL;
+	listSim.setPrefetchLog(log);
+	hashSim.setPrefetchLog(log);
+	prefetched.clear();
+	// the write buffer runs on the model's clock
+	writeBuffer.setAccessTime(memModel.enabled() ? memModel.getHitTime() : 1);
+}
+
+void cachesim::setWritePolicy(write_policy_t policy, uint64_t entries, uint64_t drain_interval) {
+	writePolicy = policy;
+	engine->setWritePolicy(policy);
+	writeBuffer.configure(policy != WRITE_BACK, entries, drain_interval);
+}
+
+void cachesim::access(char rw, uint64_t address, cache_stats_t *p_stats) {
+	cache_access_t result = engine->cacheAccess(rw, address);
+	record_access(rw, result, p_stats);
+	// stores sent to memory: every store when writing through, otherwise only write misses that were not allocated
+	bool writeThrough = writePolicy == WRITE_THROUGH || writePolicy == WRITE_COMBINING;
+	bool store = rw == WRITE && (writeThrough || result.write_bypasses);
+	if (!memModel.enabled()) {
+		if (writeBuffer.enabled()) writeBuffer.access(store, address);
+		return;
+	}
+	memModel.access(rw, address, result, prefetched);
+	prefetched.clear();
+	if (writeBuffer.enabled()) {
+		// the store issues at the core's clock, a full buffer holds the core until its oldest entry drains
+		double ready;
+		uint64_t drained = writeBuffer.access(store, address, memModel.clock(), ready);
+		memModel.wait(ready);
+		// drained stores share the bus with fills and writebacks
+		memModel.post(drained);
+	}
+}
+
+void cachesim::accessRun(char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats) {
+	if (writeBuffer.enabled() || memModel.enabled()) {
+		for (uint64_t i = 0; i != count; ++i) access(rw, address, p_stats);
+		return;
+	}
+	engine_access_run(engine, rw, address, count, p_stats);
+}
+
+void cachesim::finish(cache_stats_t *p_stats, WriteBuffer &buffer, MemModel &model) const {
+	// bypassed write misses fetch no block, their stores reach memory through the write buffer instead
+	p_stats->bytes_saved = (1ULL << engine->getB()) * p_stats->write_bypasses;
+	uint64_t drained = buffer.enabled() ? buffer.complete(p_stats) : 0;
+	compute_statistics(engine->getB(), engine->getS(), p_stats);
+	if (model.enabled()) {
+		model.post(drained);
+		model.complete(p_stats);
+	}
+}
+
+// Global simulation driven by setup_cache, cache_access and complete_cache
+cachesim globalSim;
+
+/**
+ * Subroutine for checking a cache configuration before setting it up.
+ *
+ * @c The total number of bytes for data storage is 2^C
+ * @b The size of a single cache line in bytes is 2^B
+ * @s The number of blocks in each set is 2^S
+ * @return false if the sets do not fit in the cache, or the cache has more blocks than its engine can index
+ */
+bool valid_cache_config(uint64_t c, uint64_t b, uint64_t s) {
+	if (c >= 64 || b + s > c) return false;
+	return s < HASH_ENGINE_MIN_S || c - b <= HASH_ENGINE_MAX_BLOCK_BITS;
+}
 
 /**
  * Subroutine for initializing the cache. You many add and initialize any global or heap
@@ -195,7 +841,44 @@ CacheSim cacheSim;
  * @k The prefetch distance is K
  */
 void setup_cache(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
-	cacheSim = CacheSim(c, b, s, v, k);
+	globalSim.setup(c, b, s, v, k);
+}
+
+/**
+ * Subroutine for creating a standalone cache, for simulators that run several caches at once.
+ * Picks the engine the same way setup_cache does, the caller owns the result.
+ *
+ * @c The total number of bytes for data storage is 2^C
+ * @b The size of a single cache line in bytes is 2^B
+ * @s The number of blocks in each set is 2^S
+ * @v The number of blocks in the victim cache is V
+ * @k The prefetch distance is K
+ */
+CacheEngine *new_cache_engine(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	if (s >= HASH_ENGINE_MIN_S)
+		return new HashCacheSim(c, b, s, v, k);
+	return new CacheSim(c, b, s, v, k);
+}
+
+/**
+ * Subroutine for enabling the timing-aware memory model, call after setup_cache.
+ *
+ * @mshrs The number of outstanding misses (MSHRs), 0 disables the model
+ * @bandwidth The DRAM bandwidth in bytes per cycle
+ */
+void setup_memory(uint64_t mshrs, double bandwidth) {
+	globalSim.setMemory(mshrs, bandwidth);
+}
+
+/**
+ * Subroutine for selecting the write policy, call after setup_cache.
+ *
+ * @policy The write policy, see write_policy_t
+ * @entries The number of blocks the write buffer holds
+ * @drain_interval The number of accesses it takes to drain one write buffer entry
+ */
+void setup_write_policy(write_policy_t policy, uint64_t entries, uint64_t drain_interval) {
+	globalSim.setWritePolicy(policy, entries, drain_interval);
 }
 
 /**
@@ -207,7 +890,54 @@ void setup_cache(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
  * @p_stats Pointer to the statistics structure
  */
 void cache_access(char rw, uint64_t address, cache_stats_t* p_stats) {
-	cache_access_t result = cacheSim.cacheAccess(rw, address);
+	globalSim.access(rw, address, p_stats);
+}
+
+/**
+ * Subroutine that simulates a run of identical trace events, as collapsed by the run-length pre-pass.
+ * The first event is simulated in full, the rest hit the MRU block and are counted in bulk unless the
+ * write buffer or the memory model has to see every access.
+ *
+ * @rw The type of event. Either READ or WRITE
+ * @address  The target memory address
+ * @count The number of events in the run
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_access_run(char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats) {
+	globalSim.accessRun(rw, address, count, p_stats);
+}
+
+/**
+ * Subroutine that simulates a run of identical trace events on a standalone cache.
+ *
+ * @engine The cache, see new_cache_engine
+ * @rw The type of event. Either READ or WRITE
+ * @address  The target memory address
+ * @count The number of events in the run, an empty run simulates nothing
+ * @p_stats Pointer to the statistics structure
+ */
+void engine_access_run(CacheEngine *engine, char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats) {
+	if (!count) return;
+	record_access(rw, engine->cacheAccess(rw, address), p_stats);
+	if (count == 1) return;
+	// a bypassed write leaves nothing in the cache, the next event misses again
+	if (!engine->isMRU(address)) {
+		for (uint64_t i = 1; i != count; ++i) record_access(rw, engine->cacheAccess(rw, address), p_stats);
+		return;
+	}
+	// the dirty bit was set by the first event
+	if (rw == READ) p_stats->reads += count - 1;
+	else if (rw == WRITE) p_stats->writes += count - 1;
+}
+
+/**
+ * Subroutine that adds the outcome of one cache access to the statistics.
+ *
+ * @rw The type of event. Either READ or WRITE
+ * @result The outcome returned by CacheEngine::cacheAccess
+ * @p_stats Pointer to the statistics structure
+ */
+void record_access(char rw, const cache_access_t &result, cache_stats_t *p_stats) {
 	switch (rw) {
 	case READ:
 		++p_stats->reads;
@@ -225,6 +955,7 @@ void cache_access(char rw, uint64_t address, cache_stats_t* p_stats) {
 	p_stats->write_backs += result.writebacks;
 	p_stats->prefetched_blocks += result.prefetch_blocks;
 	p_stats->useful_prefetches += result.useful_prefetches;
+	p_stats->write_bypasses += result.write_bypasses;
 }
 
 /**
@@ -235,14 +966,145 @@ void cache_access(char rw, uint64_t address, cache_stats_t* p_stats) {
  * @p_stats Pointer to the statistics structure
  */
 void complete_cache(cache_stats_t *p_stats) {
+	globalSim.complete(p_stats);
+}
+
+/**
+ * Subroutine for calculating overall statistics such as miss rate or average access time
+ * from the counts gathered by record_access.
+ *
+ * @b The size of a single cache line in bytes is 2^B
+ * @s The number of blocks in each set is 2^S
+ * @p_stats Pointer to the statistics structure
+ */
+void compute_statistics(uint64_t b, uint64_t s, cache_stats_t *p_stats) {
 	p_stats->accesses = p_stats->reads + p_stats->writes;
 	p_stats->misses = p_stats->read_misses + p_stats->write_misses;
 	p_stats->vc_misses = p_stats->read_misses_combined + p_stats->write_misses_combined;
-	p_stats->bytes_transferred = (1 << cacheSim.getB()) * (p_stats->vc_misses + p_stats->write_backs + p_stats->prefetched_blocks);
+	p_stats->bytes_transferred = (1ULL << b) * (p_stats->vc_misses - p_stats->write_bypasses
+		+ p_stats->write_backs + p_stats->prefetched_blocks) + p_stats->write_buffer_bytes;
 	// calculate AAT
-	p_stats->hit_time = 2 + 0.2 * cacheSim.getS();
+	p_stats->hit_time = 2 + 0.2 * s;
 	p_stats->miss_rate = (double)p_stats->misses / p_stats->accesses;
-	p_stats->miss_penalty = 200;
+	p_stats->miss_penalty = MISS_PENALTY;
 	double vc_miss_rate = (double)p_stats->vc_misses / p_stats->accesses;
 	p_stats->avg_access_time = p_stats->hit_time + vc_miss_rate * p_stats->miss_penalty;
 }
+
+// ================== libcachesim C interface ==================
+
+// no exception crosses into the caller's C code: a call that runs out of memory returns NULL or -1 instead
+
+cachesim_t *cachesim_create(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) {
+	if (!valid_cache_config(c, b, s)) return NULL;
+	cachesim *sim = NULL;
+	try {
+		sim = new cachesim;
+		sim->setup(c, b, s, v, k);
+	}
+	catch (...) {
+		delete sim;
+		return NULL;
+	}
+	return sim;
+}
+
+int cachesim_set_memory(cachesim_t *sim, uint64_t mshrs, double bandwidth) {
+	if (sim->failed) return -1;
+	try {
+		sim->setMemory(mshrs, bandwidth);
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+int cachesim_set_write_policy(cachesim_t *sim, int policy, uint64_t entries, uint64_t drain_interval) {
+	if (sim->failed || policy < CACHESIM_WRITE_BACK || policy > CACHESIM_WRITE_COMBINING) return -1;
+	try {
+		sim->setWritePolicy((write_policy_t)policy, entries, drain_interval);
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+int cachesim_access(cachesim_t *sim, char rw, uint64_t address) {
+	if (sim->failed) return -1;
+	try {
+		sim->access(rw, address, &sim->stats);
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+int cachesim_access_batch(cachesim_t *sim, const char *rw, const uint64_t *addresses, size_t n) {
+	if (sim->failed) return -1;
+	CacheEngine *engine = sim->engine;
+	cache_stats_t *p_stats = &sim->stats;
+	try {
+		// nothing behind the cache to feed: skip the per-access checks
+		if (!sim->writeBuffer.enabled() && !sim->memModel.enabled()) {
+			for (size_t i = 0; i != n; ++i) record_access(rw[i], engine->cacheAccess(rw[i], addresses[i]), p_stats);
+		}
+		else {
+			for (size_t i = 0; i != n; ++i) sim->access(rw[i], addresses[i], p_stats);
+		}
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+int cachesim_access_run(cachesim_t *sim, char rw, uint64_t address, uint64_t count) {
+	if (sim->failed) return -1;
+	try {
+		sim->accessRun(rw, address, count, &sim->stats);
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	return 0;
+}
+
+int cachesim_snapshot(const cachesim_t *sim, cache_stats_t *stats, size_t size) {
+	if (sim->failed) return -1;
+	cache_stats_t snapshot;
+	try {
+		sim->snapshot(&snapshot);
+	}
+	catch (...) {
+		// the copies ran out of memory, the handle itself is intact
+		return -1;
+	}
+	memcpy(stats, &snapshot, std::min(size, sizeof(cache_stats_t)));
+	return 0;
+}
+
+int cachesim_reset(cachesim_t *sim) {
+	CacheEngine *engine = sim->engine;
+	memset(&sim->stats, 0, sizeof(cache_stats_t));
+	try {
+		sim->setup(engine->getC(), engine->getB(), engine->getS(), engine->getV(), engine->getK());
+	}
+	catch (...) {
+		sim->failed = true;
+		return -1;
+	}
+	sim->failed = false;
+	return 0;
+}
+
+void cachesim_destroy(cachesim_t *sim) {
+	delete sim;
+}
@@ -4,10 +4,24 @@
 #include <cinttypes>
 
 #include <vector>
-#include <list>
+
+#include "arena.hpp"
+#include "libcachesim.h"
+#include "profile.hpp"
 
 using std::vector;
-using std::list;
+
+// write policies
+// WRITE_BACK: write-back, write-allocate (default)
+// WRITE_THROUGH: write-through, write-allocate, blocks are never dirty
+// WRITE_NO_ALLOCATE: write-back on hits, write misses go around the cache
+// WRITE_COMBINING: write-through, no-write-allocate, all stores are merged in the write buffer
+enum write_policy_t {
+	WRITE_BACK = CACHESIM_WRITE_BACK,
+	WRITE_THROUGH = CACHESIM_WRITE_THROUGH,
+	WRITE_NO_ALLOCATE = CACHESIM_NO_WRITE_ALLOCATE,
+	WRITE_COMBINING = CACHESIM_WRITE_COMBINING
+};
 
 // return struct for cache access function
 struct cache_access_t {
@@ -15,33 +29,74 @@ struct cache_access_t {
 	int vc_misses;
 	int writebacks;
 	int useful_prefetches;
+	int write_bypasses; // write misses that were not allocated (no block fetched)
 	uint64_t prefetch_blocks;
-	cache_access_t() : misses(0), vc_misses(0), writebacks(0), useful_prefetches(0), prefetch_blocks(0) {}
+	int64_t prefetch_stride; // block distance between consecutive prefetched blocks, signed
+	cache_access_t() : misses(0), vc_misses(0), writebacks(0), useful_prefetches(0), write_bypasses(0), prefetch_blocks(0), prefetch_stride(0) {}
 };
 
-// class for cache simulation
-class CacheSim {
+// common interface of the cache simulation engines
+// holds the cache configuration and the stride prefetcher state shared by all engines
+class CacheEngine {
 public:
-	CacheSim() : c(0), b(0), s(0), v(0), k(0), set_capacity(0) {}
-	CacheSim(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) : c(c), b(b), s(s), v(v), k(k),
-		// # blocks per set: 2 ^ s -> set capacity
-		set_capacity(1 << s),
-		// total # blocks: 2 ^ (c - b)
-		// # sets: 2 ^ (c - b - s)
-		cacheSets(vector<list<CacheNode>>(1 << (c - b - s))),
-		// prefetcher variables initialized to zero
-		last_miss(0), pending_stride(0), stride_sign(true) {}
-	cache_access_t cacheAccess(char rw, uint64_t address); // member function that performs cache access
+	virtual ~CacheEngine() {}
+	// (re)initialize the engine to an empty cache of the given configuration, storage is kept for reuse
+	virtual void configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+	virtual cache_access_t cacheAccess(char rw, uint64_t address) = 0; // member function that performs cache access
+	// coherence hooks for the multi-core simulator, they leave LRU order and prefetcher state alone
+	virtual bool contains(uint64_t address) = 0; // block is in L1 or VC
+	virtual bool invalidate(uint64_t address) = 0; // drop the block, returns true if it was dirty (write back)
+	virtual bool clean(uint64_t address) = 0; // clear the dirty bit, returns true if it was dirty (write back)
+	// same-block fast path: the block was accessed last and is still MRU, so the next access to it is a hit that
+	// changes nothing but the dirty bit
+	virtual bool isMRU(uint64_t address) = 0;
+	// write policy is kept across configure()
+	void setWritePolicy(write_policy_t policy) {
+		write_back = policy == WRITE_BACK || policy == WRITE_NO_ALLOCATE;
+		write_allocate = policy == WRITE_BACK || policy == WRITE_THROUGH;
+	}
+	// block addresses the prefetcher fetches from memory are appended to log, NULL (default) keeps no log
+	void setPrefetchLog(vector<uint64_t> *log) { prefetch_log = log; }
 	uint64_t getC() { return c; } // read-only
 	uint64_t getB() { return b; } // read-only
 	uint64_t getS() { return s; } // read-only
 	uint64_t getV() { return v; } // read-only
 	uint64_t getK() { return k; } // read-only
-private:
+protected:
+	CacheEngine() : c(0), b(0), s(0), v(0), k(0), set_capacity(0), idx_mask(0), write_back(true),
+		write_allocate(true), last_miss(0), pending_stride(0), stride_sign(true), prefetch_log(NULL) {}
 	uint64_t c, b, s, v, k;
 	uint64_t set_capacity; // associativity (2^s)
+	uint64_t idx_mask; // # sets - 1, the index of a block address is block & idx_mask
+	bool write_back; // writes set the dirty bit, otherwise they are sent through to memory
+	bool write_allocate; // write misses fetch the block
+	// prefetcher variables: last_miss, pending_stride, stride_sign
+	uint64_t last_miss;
+	uint64_t pending_stride;
+	bool stride_sign; // 1 is positive and 0 is negative
+	vector<uint64_t> *prefetch_log;
+private:
+	// engines own node storage, never copy them
+	CacheEngine(const CacheEngine &);
+	CacheEngine &operator=(const CacheEngine &);
+};
+
+// class for cache simulation, reference engine: each set is a list probed linearly
+class CacheSim : public CacheEngine {
+public:
+	CacheSim() : last_block(0), last_node(NULL) {}
+	CacheSim(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) : last_block(0), last_node(NULL) {
+		configure(c, b, s, v, k);
+	}
+	void configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+	cache_access_t cacheAccess(char rw, uint64_t address); // member function that performs cache access
+	bool contains(uint64_t address);
+	bool invalidate(uint64_t address);
+	bool clean(uint64_t address);
+	bool isMRU(uint64_t address) { return last_node && (address >> b) == last_block; }
+private:
 	// struct for L1 cache block, stores only tag
-	struct CacheNode {
+	struct CacheNode : ListHook<CacheNode> {
 		uint64_t tag;
 		bool dirty;
 		bool isPrefetch;
@@ -52,52 +107,134 @@ private:
 		CacheNode(uint64_t addrTag, bool dir, bool pref) : tag(addrTag), dirty(dir), isPrefetch(pref) {}
 	};
 	// struct for victim cache block, stores both tag and index
-	struct VCNode {
+	struct VCNode : ListHook<VCNode> {
 		uint64_t tag;
-		unsigned int idx;
+		uint64_t idx;
 		bool dirty;
 		bool isPrefetch;
 		VCNode() : tag(0), idx(0), dirty(false), isPrefetch(false) {}
 		// fetch block from L1 cache: store both tag and index value, preserve dirty bit and prefetch bit
-		VCNode(CacheNode block, unsigned int index) : tag(block.tag), idx(index),
+		VCNode(CacheNode block, uint64_t index) : tag(block.tag), idx(index),
 			dirty(block.dirty), isPrefetch(block.isPrefetch) {}
 	};
+	CacheNode *findBlock(uint64_t address); // L1 node holding the block, NULL if none
+	VCNode *findVictim(uint64_t address); // VC node holding the block, NULL if none
+	// take a node from the arena and initialize it
+	CacheNode *newNode(const CacheNode &block) { CacheNode *node = l1Nodes.alloc(); *node = block; return node; }
+	VCNode *newNode(const VCNode &block) { VCNode *node = vcNodes.alloc(); *node = block; return node; }
 	// block containers: cacheSets, victimCache
 	// each list represents a set in L1 cache, MRU block resides at the front and LRU at the back
-	// the huge vector holds all the lists
-	vector<list<CacheNode>> cacheSets; 
+	// the huge array holds all the lists, materialized as the trace touches them
+	LazyArray<NodeList<CacheNode>> cacheSets;
 	// oldest block resides at the front and newest at the back (always insert from the back!)
-	list<VCNode> victimCache;
-	// prefetcher variables: last_miss, pending_stride, stride_sign
-	uint64_t last_miss;
-	uint64_t pending_stride;
-	bool stride_sign; // 1 is positive and 0 is negative
+	NodeList<VCNode> victimCache;
+	// node storage: up to 2 ^ (c - b) L1 blocks and v VC blocks
+	NodeArena<CacheNode> l1Nodes;
+	NodeArena<VCNode> vcNodes;
+	// same-block fast path: block address of the last access and its node while it is MRU, NULL otherwise
+	uint64_t last_block;
+	CacheNode *last_node;
 };
 
-struct cache_stats_t {
-    uint64_t accesses;
-    uint64_t reads;
-    uint64_t read_misses;
-    uint64_t read_misses_combined;
-    uint64_t writes;
-    uint64_t write_misses;
-    uint64_t write_misses_combined;
-    uint64_t misses;
-	uint64_t write_backs;
-	uint64_t vc_misses;
-	uint64_t prefetched_blocks;
-	uint64_t useful_prefetches;
-	uint64_t bytes_transferred; 
-   
-	double   hit_time;
-	double   miss_rate;
-	uint64_t miss_penalty;
-    double   avg_access_time;
+// class for cache simulation, engine for high associativity
+// all blocks live in a slot pool, each set is an intrusive doubly-linked LRU list over its slots, and a hash table
+// maps block address to slot so that hit, miss and eviction are all O(1)
+// the pool and the hash table grow with the resident blocks and sets are materialized as the trace touches them,
+// so large caches cost memory in proportion to their footprint; slot indices are 32 bits wide, which limits the
+// engine to 2 ^ HASH_ENGINE_MAX_BLOCK_BITS blocks (valid_cache_config rejects larger caches)
+// produces exactly the same results as CacheSim
+class HashCacheSim : public CacheEngine {
+public:
+	HashCacheSim() : hash_mask(0), hash_shift(0), table_used(0), table_epoch(1), vc_head(0), vc_size(0), last_block(0),
+		last_slot(NIL) {}
+	HashCacheSim(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k) : hash_mask(0), hash_shift(0),
+		table_used(0), table_epoch(1), vc_head(0), vc_size(0), last_block(0), last_slot(NIL) {
+		configure(c, b, s, v, k);
+	}
+	void configure(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+	cache_access_t cacheAccess(char rw, uint64_t address); // member function that performs cache access
+	bool contains(uint64_t address);
+	bool invalidate(uint64_t address);
+	bool clean(uint64_t address);
+	bool isMRU(uint64_t address) { return last_slot != NIL && (address >> b) == last_block; }
+private:
+	static const uint32_t NIL = UINT32_MAX; // null slot index
+	// struct for L1 cache block, stores the whole block address (tag and index) as the hash key
+	struct Slot {
+		uint64_t block;
+		uint32_t prev, next; // towards MRU, towards LRU
+		bool dirty;
+		bool isPrefetch;
+		Slot() : block(0), prev(NIL), next(NIL), dirty(false), isPrefetch(false) {}
+	};
+	// struct for L1 cache set: MRU block at head, LRU block at tail
+	struct Set {
+		uint32_t head, tail;
+		uint32_t size;
+		Set() : head(NIL), tail(NIL), size(0) {}
+	};
+	// struct for victim cache block, the block address carries both tag and index
+	struct VCNode {
+		uint64_t block;
+		bool dirty;
+		bool isPrefetch;
+		VCNode() : block(0), dirty(false), isPrefetch(false) {}
+		VCNode(const Slot &slot) : block(slot.block), dirty(slot.dirty), isPrefetch(slot.isPrefetch) {}
+	};
+	// struct for hash table entry, open addressing with linear probing
+	struct HashEntry {
+		uint64_t block;
+		uint32_t slot;
+		uint32_t epoch; // the entry is empty unless it equals table_epoch
+		HashEntry() : block(0), slot(NIL), epoch(0) {}
+	};
+
+	// set list operations
+	void unlink(Set &set, uint32_t i);
+	void pushFront(Set &set, uint32_t i);
+	void pushBack(Set &set, uint32_t i);
+	uint32_t allocSlot(); // take a free slot from the pool
+	void removeSlot(Set &set, uint32_t i); // drop a block from the set and return slot i to the pool
+	// hash table operations
+	uint64_t hashPos(uint64_t block) const { return (block * 0x9E3779B97F4A7C15ULL) >> hash_shift; }
+	bool used(const HashEntry &entry) const { return entry.epoch == table_epoch; }
+	uint32_t find(uint64_t block, int probe = PROBE_NONE) const; // probe: profile_probe_t of the lookup
+	void insert(uint64_t block, uint32_t slot);
+	void erase(uint64_t block);
+	void resizeTable(uint64_t entries); // rehash into a table of the given size (power of 2)
+	// victim cache operations (FIFO ring buffer, oldest block at vc_head)
+	VCNode *vcFind(uint64_t block, int probe = PROBE_NONE);
+	void vcPush(const Slot &slot, cache_access_t &result); // evicts the oldest block when VC is full
+	void vcErase(VCNode *node);
+	// move the LRU block of a full set into the VC and return its slot for reuse
+	uint32_t evictToVC(Set &set, cache_access_t &result);
+
+	vector<Slot> slots; // up to 2 ^ (c - b) slots, full sets reuse the slot of their evicted block
+	vector<uint32_t> free_slots; // slots freed by invalidations
+	LazyArray<Set> cacheSets;
+	vector<HashEntry> table;
+	uint64_t hash_mask; // # table entries - 1
+	int hash_shift; // 64 - log2(# table entries)
+	uint64_t table_used; // # blocks in the table, kept at most half the entries
+	uint32_t table_epoch; // bumped by configure() to empty the table in O(1), never 0
+	vector<VCNode> victimCache;
+	uint64_t vc_head, vc_size;
+	// same-block fast path: block address of the last access and its slot while it is MRU, NIL otherwise
+	uint64_t last_block;
+	uint32_t last_slot;
 };
 
+bool valid_cache_config(uint64_t c, uint64_t b, uint64_t s);
 void setup_cache(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+CacheEngine *new_cache_engine(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
 void cache_access(char rw, uint64_t address, cache_stats_t* p_stats);
+void cache_access_run(char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats);
+void engine_access_run(CacheEngine *engine, char rw, uint64_t address, uint64_t count, cache_stats_t *p_stats);
 void complete_cache(cache_stats_t *p_stats);
+void setup_memory(uint64_t mshrs, double bandwidth);
+void setup_write_policy(write_policy_t policy, uint64_t entries, uint64_t drain_interval);
+void record_access(char rw, const cache_access_t &result, cache_stats_t *p_stats);
+void compute_statistics(uint64_t b, uint64_t s, cache_stats_t *p_stats);
 
 static const uint64_t DEFAULT_C = 15;   /* 32KB Cache */
 static const uint64_t DEFAULT_B = 5;    /* 32-byte blocks */
@@ -105,6 +242,25 @@ static const uint64_t DEFAULT_S = 3;    /* 8 blocks per set */
 static const uint64_t DEFAULT_V = 4;    /* 4 victim blocks */
 static const uint64_t DEFAULT_K = 2;	/* 2 prefetch distance */
 
+/** Memory model: 0 MSHRs disables it and AAT assumes fully serialized misses */
+static const uint64_t DEFAULT_MSHRS = 0;
+static const double   DEFAULT_BANDWIDTH = 8;	/* DRAM bytes per cycle */
+static const uint64_t MISS_PENALTY = 200;	/* cycles */
+
+/** Write policy and coalescing write buffer */
+static const write_policy_t DEFAULT_W = WRITE_BACK;
+static const uint64_t DEFAULT_WB_ENTRIES = 8;
+static const uint64_t DEFAULT_WB_DRAIN = 4;	/* accesses per drained entry */
+static const uint64_t WORD_BYTES = 8;	/* bytes written by one store */
+
+/** Blocks whose node storage and hash table are set up front, larger caches grow with the touched footprint */
+static const uint64_t EAGER_BLOCKS = 1 << 16;
+
+/** Smallest S for which setup_cache picks HashCacheSim over the list-based CacheSim */
+static const uint64_t HASH_ENGINE_MIN_S = 4;	/* 16 blocks per set */
+/** Largest C - B of HashCacheSim, slot indices are 32 bits wide and all ones is the null index */
+static const uint64_t HASH_ENGINE_MAX_BLOCK_BITS = 31;
+
 /** Argument to cache_access rw. Indicates a load */
 static const char     READ = 'r';
 /** Argument to cache_access rw. Indicates a store */
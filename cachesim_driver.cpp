@@ -13,6 +13,10 @@
 #include "XGetopt.h"
 
 #include "cachesim.hpp"
+#include "libcachesim.h"
+#include "profile.hpp"
+
+static const size_t BATCH_SIZE = 4096;	/* trace events per cachesim_access_batch call */
 
 void print_help_and_exit(void) {
 	printf("cachesim [OPTIONS] < traces/file.trace\n");
@@ -20,7 +24,13 @@ void print_help_and_exit(void) {
 	printf("  -b B\t\tSize of each block in bytes is 2^B\n");
 	printf("  -s S\t\tNumber of blocks per set is 2^S\n");
 	printf("  -v V\t\tNumber of blocks in victim cache\n");
-	printf("  -k K\t\tPrefetch Distance");
+	printf("  -k K\t\tPrefetch Distance\n");
+	printf("  -m M\t\tNumber of MSHRs, enables the timing-aware memory model\n");
+	printf("  -d D\t\tDRAM bandwidth in bytes per cycle (memory model)\n");
+	printf("  -w W\t\tWrite policy: 0 write-back, 1 write-through, 2 no-write-allocate, 3 write-combining\n");
+	printf("  -e E\t\tNumber of write buffer entries, 0 writes every store to memory on its own\n");
+	printf("  -r R\t\tAccesses to drain one write buffer entry\n");
+	printf("  -l\t\tCollapse runs of accesses to the same block before simulating them\n");
 	printf("  -h\t\tThis helpful output\n");
 	exit(0);
 }
@@ -34,10 +44,16 @@ int main(int argc, char* argv[]) {
 	uint64_t s = DEFAULT_S;
 	uint64_t v = DEFAULT_V;
 	uint64_t k = DEFAULT_K;
+	uint64_t m = DEFAULT_MSHRS;
+	double d = DEFAULT_BANDWIDTH;
+	int w = DEFAULT_W;
+	uint64_t e = DEFAULT_WB_ENTRIES;
+	uint64_t r = DEFAULT_WB_DRAIN;
+	bool l = false;
 	FILE* fin  = stdin;
 
 	/* Read arguments */ 
-	while(-1 != (opt = getopt(argc, argv, "c:b:s:i:v:k:h"))) {
+	while(-1 != (opt = getopt(argc, argv, "c:b:s:i:v:k:m:d:w:e:r:lh"))) {
 		switch(opt) {
 		case 'c':
 			c = atoi(optarg);
@@ -54,6 +70,25 @@ int main(int argc, char* argv[]) {
 		case 'k':
 			k = atoi(optarg);
 			break;
+		case 'm':
+			m = atoi(optarg);
+			break;
+		case 'd':
+			d = atof(optarg);
+			break;
+		case 'w':
+			w = atoi(optarg);
+			if (w < WRITE_BACK || w > WRITE_COMBINING) print_help_and_exit();
+			break;
+		case 'e':
+			e = atoi(optarg);
+			break;
+		case 'r':
+			r = atoi(optarg);
+			break;
+		case 'l':
+			l = true;
+			break;
 		case 'i':
 			fin = fopen(optarg, "r");
 			break;
@@ -71,28 +106,101 @@ int main(int argc, char* argv[]) {
 	printf("S: %" PRIu64 "\n", s);
 	printf("V: %" PRIu64 "\n", v);
 	printf("K: %" PRIu64 "\n", k);
+	if (m) {
+		printf("M: %" PRIu64 "\n", m);
+		printf("D: %f\n", d);
+	}
+	if (w != WRITE_BACK) {
+		printf("W: %d\n", w);
+		printf("E: %" PRIu64 "\n", e);
+		printf("R: %" PRIu64 "\n", r);
+	}
 	printf("\n");
 
 	/* Setup the cache */
-	setup_cache(c, b, s, v, k);
-
-	/* Setup statistics */
-	cache_stats_t stats;
-	memset(&stats, 0, sizeof(cache_stats_t));
+	cachesim_t *sim = cachesim_create(c, b, s, v, k);
+	if (!sim) {
+		printf("Invalid cache configuration\n");
+		exit(1);
+	}
+	if (cachesim_set_memory(sim, m, d) != 0) {
+		printf("Invalid memory configuration\n");
+		exit(1);
+	}
+	cachesim_set_write_policy(sim, w, e, r);
 
-	/* Begin reading the file */ 
+	/* Begin reading the file, events are handed to the simulator a batch at a time */ 
+	PROFILE_START();
+	PROFILE_ENTER(PHASE_INGEST);
 	char rw;
 	uint64_t address;
+	static char batch_rw[BATCH_SIZE];
+	static uint64_t batch_address[BATCH_SIZE];
+	size_t batch = 0;
+	// run-length pre-pass: consecutive events of the same type to the same block become one weighted event
+	// the write buffer tracks words, so runs must stay on one address when it is in use
+	const uint64_t run_shift = w == WRITE_BACK ? b : 0;
+	char run_rw = 0;
+	uint64_t run_address = 0;
+	uint64_t run_count = 0;
+	static char runs_rw[BATCH_SIZE];
+	static uint64_t runs_address[BATCH_SIZE];
+	static uint64_t runs_count[BATCH_SIZE];
+	size_t runs = 0;
 	while (!feof(fin)) { 
 		int ret = fscanf(fin, "%c %" PRIx64 "\n", &rw, &address); 
 		if(ret == 2) {
-			cache_access(rw, address, &stats); 
+			if (!l) {
+				batch_rw[batch] = rw;
+				batch_address[batch] = address;
+				if (++batch == BATCH_SIZE) {
+					PROFILE_ENTER(PHASE_SIMULATE);
+					cachesim_access_batch(sim, batch_rw, batch_address, batch);
+					PROFILE_LEAVE();
+					batch = 0;
+				}
+			}
+			else if (run_count && rw == run_rw && (address >> run_shift) == (run_address >> run_shift)) {
+				++run_count;
+			}
+			else {
+				// finished runs are handed to the simulator a batch at a time as well
+				if (run_count) {
+					runs_rw[runs] = run_rw;
+					runs_address[runs] = run_address;
+					runs_count[runs] = run_count;
+					if (++runs == BATCH_SIZE) {
+						PROFILE_ENTER(PHASE_SIMULATE);
+						for (size_t i = 0; i != runs; ++i) cachesim_access_run(sim, runs_rw[i], runs_address[i], runs_count[i]);
+						PROFILE_LEAVE();
+						runs = 0;
+					}
+				}
+				run_rw = rw;
+				run_address = address;
+				run_count = 1;
+			}
 		}
 	}
+	PROFILE_LEAVE();
+	PROFILE_ENTER(PHASE_SIMULATE);
+	if (batch) cachesim_access_batch(sim, batch_rw, batch_address, batch);
+	for (size_t i = 0; i != runs; ++i) cachesim_access_run(sim, runs_rw[i], runs_address[i], runs_count[i]);
+	if (run_count) cachesim_access_run(sim, run_rw, run_address, run_count);
 
-	complete_cache(&stats);
+	cache_stats_t stats;
+	// every call after running out of memory fails, the snapshot tells
+	if (cachesim_snapshot(sim, &stats, sizeof(cache_stats_t)) != 0) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	cachesim_destroy(sim);
+	PROFILE_LEAVE();
 
+	PROFILE_ENTER(PHASE_REPORT);
 	print_statistics(&stats);
+	PROFILE_LEAVE();
+	PROFILE_PRINT();
 
 	return 0;
 }
@@ -116,4 +224,17 @@ void print_statistics(cache_stats_t* p_stats) {
 	printf("Miss Penalty: %" PRIu64 "\n", p_stats->miss_penalty);
 	printf("Miss rate: %f\n", p_stats->miss_rate);
 	printf("Average access time (AAT): %f\n", p_stats->avg_access_time);
+	if (p_stats->effective_aat > 0) {
+		printf("MSHR stalls: %" PRIu64 "\n", p_stats->mshr_stalls);
+		printf("Merged misses: %" PRIu64 "\n", p_stats->merged_misses);
+		printf("Late prefetches: %" PRIu64 "\n", p_stats->late_prefetches);
+		printf("Effective AAT: %f\n", p_stats->effective_aat);
+		printf("Memory bus utilization: %f\n", p_stats->bus_utilization);
+	}
+	if (p_stats->write_buffer_bytes > 0) {
+		printf("Write bypasses: %" PRIu64 "\n", p_stats->write_bypasses);
+		printf("Write buffer stalls: %" PRIu64 "\n", p_stats->write_buffer_stalls);
+		printf("Write buffer bytes: %" PRIu64 "\n", p_stats->write_buffer_bytes);
+		printf("Bytes saved: %" PRIu64 "\n", p_stats->bytes_saved);
+	}
 }
@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <thread>
+
+// include this line if you are running under Unix environment
+// #include <unistd.h>
+// include this line if you are running under Windows environment
+#include "XGetopt.h"
+#include "cachesim.hpp"
+#include "batch.hpp"
+#include "profile.hpp"
+
+static const double AAT_MAX = 1000;
+static const double MEMORY_BUDGET_KB = 48;
+
+void print_help_and_exit(void) {
+	printf("cachesim_batch [OPTIONS] traces/a.trace traces/b.trace ...\n");
+	printf("  -f F\t\tConfigurations, one \"C B S V K\" per line (default: sweep C, B, S within the memory budget)\n");
+	printf("  -v V\t\tNumber of blocks in victim cache (default sweep)\n");
+	printf("  -k K\t\tPrefetch Distance (default sweep)\n");
+	printf("  -t T\t\tNumber of threads (default: all hardware threads)\n");
+	printf("  -o O\t\tWrite the table to file O instead of stdout\n");
+	printf("  -l\t\tCollapse runs of accesses to the same block before simulating them\n");
+	printf("  -h\t\tThis helpful output\n");
+	exit(0);
+}
+
+/* calculate memory budget of a configuration in KB, same accounting as cachesim_driver_exp */
+double total_memory_kb(const batch_config_t &config) {
+	uint64_t data_storage = (1ULL << config.b) * 8;
+	uint64_t cache_memory = (1ULL << (config.c - config.b)) * (64 - config.c + config.s + 1 + data_storage);
+	uint64_t vc_memory = config.v * (64 - config.b + 1 + data_storage);
+	return (cache_memory + vc_memory) / double((1 << 10) * 8);
+}
+
+int main(int argc, char* argv[]) {
+	int opt;
+	uint64_t v = DEFAULT_V;
+	uint64_t k = DEFAULT_K;
+	size_t t = std::thread::hardware_concurrency();
+	bool l = false;
+	FILE* fconfig = NULL;
+	FILE* fout = stdout;
+
+	/* Read arguments */ 
+	while(-1 != (opt = getopt(argc, argv, "f:v:k:t:o:lh"))) {
+		switch(opt) {
+		case 'f':
+			fconfig = fopen(optarg, "r");
+			if (!fconfig) {
+				printf("Cannot open configurations %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'v':
+			v = atoi(optarg);
+			break;
+		case 'k':
+			k = atoi(optarg);
+			break;
+		case 't':
+			t = atoi(optarg);
+			break;
+		case 'o':
+			fout = fopen(optarg, "w");
+			if (!fout) {
+				printf("Cannot open output %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'l':
+			l = true;
+			break;
+		case 'h':
+			/* Fall through */
+		default:
+			print_help_and_exit();
+			break;
+		}
+	}
+
+	vector<string> traces;
+	for (int i = optind; i < argc; ++i) traces.push_back(argv[i]);
+	if (traces.empty()) print_help_and_exit();
+
+	/* configurations from file, or the sweep of cachesim_driver_exp */
+	vector<batch_config_t> configs;
+	batch_config_t config;
+	if (fconfig) {
+		while (fscanf(fconfig, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+			&config.c, &config.b, &config.s, &config.v, &config.k) == 5) {
+			if (valid_cache_config(config.c, config.b, config.s)) configs.push_back(config);
+		}
+		fclose(fconfig);
+	}
+	else {
+		config.v = v;
+		config.k = k;
+		for (config.c = 12; config.c <= 15; ++config.c)
+			for (config.b = 3; config.b <= 6; ++config.b)
+				for (config.s = 0; config.s <= config.c - config.b; ++config.s)
+					if (total_memory_kb(config) <= MEMORY_BUDGET_KB) configs.push_back(config);
+	}
+
+	/* the worker threads read the traces as they go, so ingest counts as simulation */
+	PROFILE_START();
+	PROFILE_ENTER(PHASE_SIMULATE);
+	BatchSim sim(traces, configs, t, DEFAULT_CHUNK, l);
+	if (!sim.run()) {
+		printf("Cannot open traces\n");
+		exit(1);
+	}
+	PROFILE_LEAVE();
+
+	PROFILE_ENTER(PHASE_REPORT);
+
+	/* a trace without accesses has no AAT and would turn every geometric mean into NaN, leave it out */
+	vector<size_t> used;
+	for (size_t j = 0; j != traces.size(); ++j) {
+		if (!configs.empty() && !sim.getStats(j, 0)->accesses)
+			printf("Skipping trace %s: no accesses\n", traces[j].c_str());
+		else
+			used.push_back(j);
+	}
+	if (used.empty()) {
+		printf("No trace has any accesses\n");
+		exit(1);
+	}
+
+	/* one row per configuration: AAT on every trace and the geometric mean over the suite */
+	fprintf(fout, "C\tB\tS\tV\tK\tKB");
+	for (size_t i = 0; i != used.size(); ++i) fprintf(fout, "\t%s", traces[used[i]].c_str());
+	fprintf(fout, "\tgeomean\n");
+
+	double AAT_min = AAT_MAX;
+	size_t AAT_min_config = 0;
+	for (size_t i = 0; i != configs.size(); ++i) {
+		fprintf(fout, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%f",
+			configs[i].c, configs[i].b, configs[i].s, configs[i].v, configs[i].k, total_memory_kb(configs[i]));
+		double log_sum = 0;
+		for (size_t j = 0; j != used.size(); ++j) {
+			double AAT = sim.getStats(used[j], i)->avg_access_time;
+			fprintf(fout, "\t%f", AAT);
+			log_sum += log(AAT);
+		}
+		double geomean = exp(log_sum / used.size());
+		fprintf(fout, "\t%f\n", geomean);
+
+		// update optimal setting
+		if (geomean < AAT_min) {
+			AAT_min = geomean;
+			AAT_min_config = i;
+		}
+	}
+
+	if (!configs.empty()) {
+		const batch_config_t &best = configs[AAT_min_config];
+		fprintf(fout, "\nBest geomean AAT: %f\n", AAT_min);
+		fprintf(fout, "Setting: %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
+			best.c, best.b, best.s, best.v, best.k);
+	}
+	if (fout != stdout) fclose(fout);
+	PROFILE_LEAVE();
+	PROFILE_PRINT();
+
+	return 0;
+}
@@ -6,8 +6,10 @@
 // include this line if you are running under Windows environment
 #include "XGetopt.h"
 #include "cachesim.hpp"
+#include "profile.hpp"
 
 static const double AAT_MAX = 1000;
+static const size_t BATCH_SIZE = 4096;	/* trace events read ahead of each simulation step */
 
 void print_help_and_exit(void) {
 	printf("cachesim [OPTIONS] < traces/file.trace\n");
@@ -15,13 +17,25 @@ void print_help_and_exit(void) {
 	printf("  -b B\t\tSize of each block in bytes is 2^B\n");
 	printf("  -s S\t\tNumber of blocks per set is 2^S\n");
 	printf("  -v V\t\tNumber of blocks in victim cache\n");
-	printf("  -k K\t\tPrefetch Distance");
+	printf("  -k K\t\tPrefetch Distance\n");
+	printf("  -m M\t\tNumber of MSHRs, enables the timing-aware memory model\n");
+	printf("  -d D\t\tDRAM bandwidth in bytes per cycle (memory model)\n");
+	printf("  -w W\t\tWrite policy: 0 write-back, 1 write-through, 2 no-write-allocate, 3 write-combining\n");
+	printf("  -e E\t\tNumber of write buffer entries, 0 writes every store to memory on its own\n");
+	printf("  -r R\t\tAccesses to drain one write buffer entry\n");
 	printf("  -h\t\tThis helpful output\n");
 	exit(0);
 }
 
 void print_statistics(cache_stats_t* p_stats);
 
+/* simulate the events read so far, timed apart from reading them */
+static void simulate_batch(const char *rw, const uint64_t *address, size_t n, cache_stats_t *p_stats) {
+	PROFILE_ENTER(PHASE_SIMULATE);
+	for (size_t i = 0; i != n; ++i) cache_access(rw[i], address[i], p_stats);
+	PROFILE_LEAVE();
+}
+
 int main(int argc, char* argv[]) {
 	int opt;
 	uint64_t c = DEFAULT_C;
@@ -29,13 +43,18 @@ int main(int argc, char* argv[]) {
 	uint64_t s = DEFAULT_S;
 	uint64_t v = DEFAULT_V;
 	uint64_t k = DEFAULT_K;
+	uint64_t m = DEFAULT_MSHRS;
+	double d = DEFAULT_BANDWIDTH;
+	int w = DEFAULT_W;
+	uint64_t e = DEFAULT_WB_ENTRIES;
+	uint64_t r = DEFAULT_WB_DRAIN;
 	FILE* fin  = stdin;
 	FILE* fout = stdout;
 	char inputfile[100];
 	char outputfile[100];
 
 	/* Read arguments */ 
-	while(-1 != (opt = getopt(argc, argv, "c:b:s:i:v:k:h"))) {
+	while(-1 != (opt = getopt(argc, argv, "c:b:s:i:v:k:m:d:w:e:r:h"))) {
 		switch(opt) {
 		case 'i':
 			strcpy(inputfile, optarg);
@@ -57,6 +76,22 @@ int main(int argc, char* argv[]) {
 		case 'k':
 			k = atoi(optarg);
 			break;
+		case 'm':
+			m = atoi(optarg);
+			break;
+		case 'd':
+			d = atof(optarg);
+			break;
+		case 'w':
+			w = atoi(optarg);
+			if (w < WRITE_BACK || w > WRITE_COMBINING) print_help_and_exit();
+			break;
+		case 'e':
+			e = atoi(optarg);
+			break;
+		case 'r':
+			r = atoi(optarg);
+			break;
 		case 'h':
 			/* Fall through */
 		default:
@@ -68,6 +103,10 @@ int main(int argc, char* argv[]) {
 	fout = fopen(outputfile, "w");
 	fprintf(fout, "%s:\n\n", inputfile);
 
+	/* with the memory model enabled, configurations are ranked by effective AAT */
+	setup_memory(m, d);
+	setup_write_policy((write_policy_t)w, e, r);
+
 	double AAT_min = AAT_MAX;
 	uint64_t AAT_min_c = DEFAULT_C;
 	uint64_t AAT_min_b = DEFAULT_B;
@@ -75,6 +114,9 @@ int main(int argc, char* argv[]) {
 	uint64_t AAT_min_v = DEFAULT_V;
 	uint64_t AAT_min_k = DEFAULT_K;
 
+	static char batch_rw[BATCH_SIZE];
+	static uint64_t batch_address[BATCH_SIZE];
+	PROFILE_START();
 	for (c = 12; c <= 15; ++c) {
 		for (b = 3; b <= 6; ++b) {
 			for (s = 0; s <= c - b; ++s) {
@@ -85,9 +127,9 @@ int main(int argc, char* argv[]) {
 						fprintf(fout, "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t", c, b, s, v, k);
 
 						/* calculate memory budge */
-						uint64_t data_storage = (1 << b) * 8;
+						uint64_t data_storage = (1ULL << b) * 8;
 						//	printf("data storage: %" PRIu64 "\n", data_storage);
-						uint64_t cache_memory = (1 << (c - b)) * (64 - c + s + 1 + data_storage);
+						uint64_t cache_memory = (1ULL << (c - b)) * (64 - c + s + 1 + data_storage);
 						//	printf("cache memory: %" PRIu64 "\n", cache_memory);
 						uint64_t vc_memory = v * (64 - b + 1 + data_storage);
 						//	printf("vc memory: %" PRIu64 "\n", vc_memory);
@@ -109,32 +151,54 @@ int main(int argc, char* argv[]) {
 						cache_stats_t stats;
 						memset(&stats, 0, sizeof(cache_stats_t));
 
-						/* Begin reading the file */
+						/* Begin reading the file, events are simulated a batch at a time */
+						PROFILE_ENTER(PHASE_INGEST);
 						fin = fopen(inputfile, "r");
 						char rw;
 						uint64_t address;
+						size_t batch = 0;
 						while (!feof(fin)) {
 							int ret = fscanf(fin, "%c %" PRIx64 "\n", &rw, &address);
 							if (ret == 2) {
-								cache_access(rw, address, &stats);
+								batch_rw[batch] = rw;
+								batch_address[batch] = address;
+								if (++batch == BATCH_SIZE) {
+									simulate_batch(batch_rw, batch_address, batch, &stats);
+									batch = 0;
+								}
 							}
 						}
 						fclose(fin);
+						PROFILE_LEAVE();
 
+						PROFILE_ENTER(PHASE_SIMULATE);
+						simulate_batch(batch_rw, batch_address, batch, &stats);
 						complete_cache(&stats);
+						PROFILE_LEAVE();
 
-						printf("%f\n", stats.avg_access_time);
-						fprintf(fout, "%f\n", stats.avg_access_time);
+						PROFILE_ENTER(PHASE_REPORT);
+						double AAT = stats.avg_access_time;
+						if (m) {
+							/* AAT, effective AAT, bus utilization */
+							printf("%f\t%f\t%f\n", stats.avg_access_time, stats.effective_aat, stats.bus_utilization);
+							fprintf(fout, "%f\t%f\t%f\n", stats.avg_access_time, stats.effective_aat, stats.bus_utilization);
+							AAT = stats.effective_aat;
+						}
+						else {
+							printf("%f\n", stats.avg_access_time);
+							fprintf(fout, "%f\n", stats.avg_access_time);
+						}
 
 						// update optimal setting
-						if (stats.avg_access_time < AAT_min) {
-							AAT_min = stats.avg_access_time;
+						if (AAT < AAT_min) {
+							AAT_min = AAT;
 							AAT_min_c = c;
 							AAT_min_b = b;
 							AAT_min_s = s;
 							AAT_min_v = v;
 							AAT_min_k = k;
 						}
+						PROFILE_LEAVE();
 
 //					}
 //				}
@@ -142,6 +206,7 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	PROFILE_ENTER(PHASE_REPORT);
 	printf("\nBest AAT: %f\n", AAT_min);
 	fprintf(fout, "\nBest AAT: %f\n", AAT_min);
 	printf("Setting: %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
@@ -149,6 +214,8 @@ int main(int argc, char* argv[]) {
 	fprintf(fout, "Setting: %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
 		AAT_min_c, AAT_min_b, AAT_min_s, AAT_min_v, AAT_min_k);
 	fclose(fout);
+	PROFILE_LEAVE();
+	PROFILE_PRINT();
 
 	return 0;
 }
@@ -173,5 +240,18 @@ void print_statistics(cache_stats_t* p_stats) {
 	printf("Miss Penalty: %" PRIu64 "\n", p_stats->miss_penalty);
 	printf("Miss rate: %f\n", p_stats->miss_rate);
 	printf("Average access time (AAT): %f\n", p_stats->avg_access_time);
+	if (p_stats->effective_aat > 0) {
+		printf("MSHR stalls: %" PRIu64 "\n", p_stats->mshr_stalls);
+		printf("Merged misses: %" PRIu64 "\n", p_stats->merged_misses);
+		printf("Late prefetches: %" PRIu64 "\n", p_stats->late_prefetches);
+		printf("Effective AAT: %f\n", p_stats->effective_aat);
+		printf("Memory bus utilization: %f\n", p_stats->bus_utilization);
+	}
+	if (p_stats->write_buffer_bytes > 0) {
+		printf("Write bypasses: %" PRIu64 "\n", p_stats->write_bypasses);
+		printf("Write buffer stalls: %" PRIu64 "\n", p_stats->write_buffer_stalls);
+		printf("Write buffer bytes: %" PRIu64 "\n", p_stats->write_buffer_bytes);
+		printf("Bytes saved: %" PRIu64 "\n", p_stats->bytes_saved);
+	}
 }
 
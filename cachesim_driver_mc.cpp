@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/* include the following line if you are running under Unix environment
+**/
+// #include <unistd.h>
+
+/* include the following line if you are running under Windows environment 
+** "XGetopt.h" and "XGetopt.cpp" can be download at
+** http://www.codeproject.com/Articles/1940/XGetopt-A-Unix-compatible-getopt-for-MFC-and-Win32
+**/
+#include "XGetopt.h"
+
+#include "cachesim.hpp"
+#include "multicore.hpp"
+#include "profile.hpp"
+
+void print_help_and_exit(void) {
+	printf("cachesim_mc [OPTIONS] traces/core0.trace traces/core1.trace ...\n");
+	printf("  -c C\t\tL1 total size in bytes is 2^C\n");
+	printf("  -b B\t\tSize of each block in bytes is 2^B\n");
+	printf("  -s S\t\tNumber of blocks per L1 set is 2^S\n");
+	printf("  -v V\t\tNumber of blocks in victim cache\n");
+	printf("  -k K\t\tPrefetch Distance\n");
+	printf("  -C C\t\tShared L2 total size in bytes is 2^C\n");
+	printf("  -S S\t\tNumber of blocks per L2 set is 2^S\n");
+	printf("  -q Q\t\tAccesses per core between synchronizations\n");
+	printf("  -t T\t\tNumber of threads, 0 for one per core\n");
+	printf("  -h\t\tThis helpful output\n");
+	exit(0);
+}
+
+void print_statistics(cache_stats_t* p_stats);
+void print_coherence(const coherence_stats_t &coherence);
+
+int main(int argc, char* argv[]) {
+	int opt;
+	uint64_t c = DEFAULT_C;
+	uint64_t b = DEFAULT_B;
+	uint64_t s = DEFAULT_S;
+	uint64_t v = DEFAULT_V;
+	uint64_t k = DEFAULT_K;
+	uint64_t l2_c = DEFAULT_L2_C;
+	uint64_t l2_s = DEFAULT_L2_S;
+	uint64_t q = DEFAULT_QUANTUM;
+	uint64_t t = 0;
+
+	/* Read arguments */ 
+	while(-1 != (opt = getopt(argc, argv, "c:b:s:v:k:C:S:q:t:h"))) {
+		switch(opt) {
+		case 'c':
+			c = atoi(optarg);
+			break;
+		case 'b':
+			b = atoi(optarg);
+			break;
+		case 's':
+			s = atoi(optarg);
+			break;
+		case 'v':
+			v = atoi(optarg);
+			break;
+		case 'k':
+			k = atoi(optarg);
+			break;
+		case 'C':
+			l2_c = atoi(optarg);
+			break;
+		case 'S':
+			l2_s = atoi(optarg);
+			break;
+		case 'q':
+			q = atoi(optarg);
+			break;
+		case 't':
+			t = atoi(optarg);
+			break;
+		case 'h':
+			/* Fall through */
+		default:
+			print_help_and_exit();
+			break;
+		}
+	}
+
+	/* one trace per core */
+	vector<FILE*> traces;
+	for (int i = optind; i < argc; ++i) {
+		FILE* fin = fopen(argv[i], "r");
+		if (!fin) {
+			printf("Cannot open trace %s\n", argv[i]);
+			exit(1);
+		}
+		traces.push_back(fin);
+	}
+	if (traces.empty() || traces.size() > MAX_CORES || q == 0) print_help_and_exit();
+	if (!valid_cache_config(c, b, s) || !valid_cache_config(l2_c, b, l2_s)) {
+		printf("Invalid cache configuration\n");
+		exit(1);
+	}
+
+	printf("Cache Settings\n");
+	printf("Cores: %d\n", (int)traces.size());
+	printf("C: %" PRIu64 "\n", c);
+	printf("B: %" PRIu64 "\n", b);
+	printf("S: %" PRIu64 "\n", s);
+	printf("V: %" PRIu64 "\n", v);
+	printf("K: %" PRIu64 "\n", k);
+	printf("L2 C: %" PRIu64 "\n", l2_c);
+	printf("L2 S: %" PRIu64 "\n", l2_s);
+	printf("Quantum: %" PRIu64 "\n", q);
+	printf("\n");
+
+	/* Simulate all cores, the worker threads read the traces as they go so ingest counts as simulation */
+	PROFILE_START();
+	PROFILE_ENTER(PHASE_SIMULATE);
+	MultiCoreSim sim(traces, c, b, s, v, k, l2_c, l2_s, q, t);
+	sim.run();
+	PROFILE_LEAVE();
+
+	PROFILE_ENTER(PHASE_REPORT);
+	coherence_stats_t total;
+	for (size_t i = 0; i != sim.getCores(); ++i) {
+		printf("Core %d: %s\n", (int)i, argv[optind + i]);
+		print_statistics(sim.getStats(i));
+		print_coherence(sim.getCoherence(i));
+		printf("\n");
+		const coherence_stats_t &coherence = sim.getCoherence(i);
+		total.invalidations += coherence.invalidations;
+		total.false_sharing += coherence.false_sharing;
+		total.coherence_misses += coherence.coherence_misses;
+		total.upgrades += coherence.upgrades;
+		total.downgrades += coherence.downgrades;
+		total.coherence_writebacks += coherence.coherence_writebacks;
+	}
+
+	printf("Shared L2\n");
+	printf("Accesses: %" PRIu64 "\n", sim.getL2Stats()->accesses);
+	printf("Misses: %" PRIu64 "\n", sim.getL2Stats()->misses);
+	printf("Miss rate: %f\n", sim.getL2Stats()->miss_rate);
+	printf("\n");
+
+	printf("All cores\n");
+	print_coherence(total);
+	printf("\n");
+
+	printf("False sharing hotspots\n");
+	vector<hotspot_t> hotspots = sim.getHotspots(HOTSPOTS);
+	for (size_t i = 0; i != hotspots.size(); ++i)
+		printf("Block 0x%" PRIx64 ": invalidations %" PRIu64 ", false sharing %" PRIu64 "\n",
+			hotspots[i].block << b, hotspots[i].invalidations, hotspots[i].false_sharing);
+	PROFILE_LEAVE();
+	PROFILE_PRINT();
+
+	for (size_t i = 0; i != traces.size(); ++i) fclose(traces[i]);
+	return 0;
+}
+
+void print_statistics(cache_stats_t* p_stats) {
+	printf("Accesses: %" PRIu64 "\n", p_stats->accesses);
+	printf("Reads: %" PRIu64 "\n", p_stats->reads);
+	printf("Read misses: %" PRIu64 "\n", p_stats->read_misses);
+	printf("Read misses combined: %" PRIu64 "\n", p_stats->read_misses_combined);
+	printf("Writes: %" PRIu64 "\n", p_stats->writes);
+	printf("Write misses: %" PRIu64 "\n", p_stats->write_misses);
+	printf("Write misses combined: %" PRIu64 "\n", p_stats->write_misses_combined);
+	printf("Misses: %" PRIu64 "\n", p_stats->misses);
+	printf("Writebacks: %" PRIu64 "\n", p_stats->write_backs);
+	printf("Victim cache misses: %" PRIu64 "\n", p_stats->vc_misses);
+	printf("Prefetched blocks: %" PRIu64 "\n", p_stats->prefetched_blocks);
+	printf("Useful prefetches: %" PRIu64 "\n", p_stats->useful_prefetches);
+	printf("Miss rate: %f\n", p_stats->miss_rate);
+	printf("Average access time (AAT): %f\n", p_stats->avg_access_time);
+}
+
+void print_coherence(const coherence_stats_t &coherence) {
+	printf("Invalidations: %" PRIu64 "\n", coherence.invalidations);
+	printf("False sharing invalidations: %" PRIu64 "\n", coherence.false_sharing);
+	printf("Coherence misses: %" PRIu64 "\n", coherence.coherence_misses);
+	printf("Upgrades: %" PRIu64 "\n", coherence.upgrades);
+	printf("Downgrades: %" PRIu64 "\n", coherence.downgrades);
+	printf("Coherence writebacks: %" PRIu64 "\n", coherence.coherence_writebacks);
+}
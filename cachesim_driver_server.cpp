@@ -0,0 +1,91 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/* the server needs sockets and named pipes, so it is built for Unix environments only
+**/
+#include <unistd.h>
+
+#include "cachesim.hpp"
+#include "profile.hpp"
+#include "server.hpp"
+
+/* the running server, stopped by SIGINT and SIGTERM */
+static TraceServer *server = NULL;
+
+void stop_server(int signum) {
+	(void)signum;
+	if (server) server->stop();
+}
+
+void print_help_and_exit(void) {
+	printf("cachesim_server [OPTIONS]\n");
+	printf("  -u U\t\tAccept trace streams on the Unix-domain socket U\n");
+	printf("  -p P\t\tRead trace streams from the named pipe P (repeat for several pipes)\n");
+	printf("  -n N\t\tNumber of reads buffered per stream before the writer is blocked\n");
+	printf("  -h\t\tThis helpful output\n");
+	printf("\n");
+	printf("A stream starts with the line \"C B S V K text|binary [W E R [M D]]\" followed by the trace;\n");
+	printf("W E R and M D are the -w -e -r and -m -d options of cachesim, defaults as there:\n");
+	printf("  text\t\tone \"r|w address\" per line as in trace files, \"?\" requests the statistics\n");
+	printf("  binary\t9 bytes per record: 'r', 'w' or '?' and the address as 64-bit little-endian\n");
+	printf("Statistics are sent back over the socket (printed for named pipes) when requested and at the end.\n");
+	printf("SIGINT or SIGTERM ends the streams in progress, removes the socket and exits.\n");
+	exit(0);
+}
+
+int main(int argc, char* argv[]) {
+	int opt;
+	string u;
+	vector<string> p;
+	size_t n = DEFAULT_BUFFER_CHUNKS;
+
+	/* Read arguments */ 
+	while(-1 != (opt = getopt(argc, argv, "u:p:n:h"))) {
+		switch(opt) {
+		case 'u':
+			u = optarg;
+			break;
+		case 'p':
+			p.push_back(optarg);
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'h':
+			/* Fall through */
+		default:
+			print_help_and_exit();
+			break;
+		}
+	}
+	if (u.empty() && p.empty()) print_help_and_exit();
+
+	/* clients that hang up early must not take the server down */
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Server Settings\n");
+	if (!u.empty()) printf("Socket: %s\n", u.c_str());
+	for (size_t i = 0; i != p.size(); ++i) printf("Pipe: %s\n", p[i].c_str());
+	printf("Buffer: %d\n", (int)n);
+	printf("\n");
+	fflush(stdout);
+
+	TraceServer trace_server(u, p, n);
+	server = &trace_server;
+	signal(SIGINT, stop_server);
+	signal(SIGTERM, stop_server);
+	/* reading and simulating overlap in the stream threads, the profile covers the whole life of the server */
+	PROFILE_START();
+	PROFILE_ENTER(PHASE_SIMULATE);
+	if (!trace_server.run()) {
+		printf("Cannot listen on the socket or pipes\n");
+		exit(1);
+	}
+	PROFILE_LEAVE();
+	server = NULL;
+	PROFILE_PRINT();
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef LIBCACHESIM_H
+#define LIBCACHESIM_H
+
+/* libcachesim: the cache simulator as a library, for tracers that feed it addresses in-process
+**
+** the C interface works on an opaque handle, one per simulated cache; handles are independent, a handle must not be
+** used by two threads at once. Fields of cache_stats_t are only ever appended, cachesim_snapshot copies as many
+** bytes as the caller's structure has, so programs built against an older header keep working.
+**
+** no C++ exception escapes the interface: a call that runs out of memory returns NULL or -1, and every later call
+** on that handle returns -1 until cachesim_reset succeeds.
+**/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the shared library is built with hidden visibility, only the entry points below are exported */
+#if defined(__GNUC__)
+#define CACHESIM_API __attribute__((visibility("default")))
+#else
+#define CACHESIM_API
+#endif
+
+/* write policies for cachesim_set_write_policy */
+#define CACHESIM_WRITE_BACK         0   /* write-back, write-allocate (default) */
+#define CACHESIM_WRITE_THROUGH      1   /* write-through, write-allocate, blocks are never dirty */
+#define CACHESIM_NO_WRITE_ALLOCATE  2   /* write-back on hits, write misses go around the cache */
+#define CACHESIM_WRITE_COMBINING    3   /* write-through, no-write-allocate, stores are merged in the write buffer */
+
+/* statistics of one simulation, completed by complete_cache or cachesim_snapshot */
+typedef struct cache_stats_t {
+    uint64_t accesses;
+    uint64_t reads;
+    uint64_t read_misses;
+    uint64_t read_misses_combined;
+    uint64_t writes;
+    uint64_t write_misses;
+    uint64_t write_misses_combined;
+    uint64_t misses;
+	uint64_t write_backs;
+	uint64_t vc_misses;
+	uint64_t prefetched_blocks;
+	uint64_t useful_prefetches;
+	uint64_t bytes_transferred; 
+   
+	double   hit_time;
+	double   miss_rate;
+	uint64_t miss_penalty;
+    double   avg_access_time;
+
+	/* timing-aware memory model, only filled in when setup_memory enabled it */
+	uint64_t mshr_stalls;
+	uint64_t merged_misses;
+	uint64_t late_prefetches;
+	double   effective_aat;
+	double   bus_utilization;
+
+	/* write policy and write buffer */
+	uint64_t write_bypasses;
+	uint64_t write_buffer_stalls;
+	uint64_t write_buffer_bytes;
+	uint64_t bytes_saved;
+} cache_stats_t;
+
+typedef struct cachesim cachesim_t;
+
+/** Create a cache of 2^C bytes, 2^B-byte blocks, 2^S blocks per set, V victim blocks and prefetch distance K.
+ *  Returns NULL for an invalid configuration or one that cannot be allocated */
+CACHESIM_API cachesim_t *cachesim_create(uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k);
+/** Enable the timing-aware memory model with the given number of MSHRs (0 disables it) and DRAM bytes per cycle.
+ *  Returns 0, or -1 when out of memory */
+CACHESIM_API int cachesim_set_memory(cachesim_t *sim, uint64_t mshrs, double bandwidth);
+/** Select the write policy (one of CACHESIM_WRITE_BACK ... CACHESIM_WRITE_COMBINING) and size the write buffer,
+ *  0 entries writes every store to memory on its own. Returns 0, or -1 for an unknown policy (nothing changes) or
+ *  when out of memory */
+CACHESIM_API int cachesim_set_write_policy(cachesim_t *sim, int policy, uint64_t entries, uint64_t drain_interval);
+/** Simulate one access, rw is 'r' or 'w'. The simulating calls return 0, or -1 when out of memory */
+CACHESIM_API int cachesim_access(cachesim_t *sim, char rw, uint64_t address);
+/** Simulate n accesses, access i is rw[i] to addresses[i]; both arrays are read in place and can be refilled as
+ *  soon as the call returns */
+CACHESIM_API int cachesim_access_batch(cachesim_t *sim, const char *rw, const uint64_t *addresses, size_t n);
+/** Simulate count back-to-back accesses of the same type to the same address, a count of 0 simulates nothing */
+CACHESIM_API int cachesim_access_run(cachesim_t *sim, char rw, uint64_t address, uint64_t count);
+/** Copy the statistics so far, with miss rate and AAT computed, into the first size bytes of stats; the simulation
+ *  can go on afterwards. Returns 0, or -1 (stats untouched) when out of memory */
+CACHESIM_API int cachesim_snapshot(const cachesim_t *sim, cache_stats_t *stats, size_t size);
+/** Empty the cache and clear the statistics, the configuration is kept. Returns 0, or -1 when out of memory */
+CACHESIM_API int cachesim_reset(cachesim_t *sim);
+CACHESIM_API void cachesim_destroy(cachesim_t *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCACHESIM_H */
@@ -0,0 +1,99 @@
+#include "memmodel.hpp"
+
+#include <cstddef>
+
+#include <algorithm>
+
+using std::max;
+
+void MemModel::configure(uint64_t mshrs, double bandwidth) {
+	this->mshrs = mshrs;
+	this->bandwidth = bandwidth;
+	reset(block_bits, hit_time);
+}
+
+void MemModel::reset(uint64_t b, double hit_time) {
+	block_bits = b;
+	this->hit_time = hit_time;
+	table.assign(mshrs, MSHR());
+	now = 0;
+	bus_free = 0;
+	bus_busy = 0;
+	accesses = 0;
+	mshr_stalls = 0;
+	merged_misses = 0;
+	late_prefetches = 0;
+}
+
+MemModel::MSHR *MemModel::inFlight(uint64_t block) {
+	for (size_t i = 0; i != table.size(); ++i)
+		if (table[i].block == block && table[i].ready > now) return &table[i];
+	return NULL;
+}
+
+double MemModel::transfer(double start, uint64_t bytes) {
+	double xfer = bytes / bandwidth;
+	double end = max(bus_free, start) + xfer;
+	bus_free = end;
+	bus_busy += xfer;
+	return end;
+}
+
+// the fill takes the MSHR that frees up first; a demand fill stalls the core until then, a prefetch just starts later
+double MemModel::fill(uint64_t block, bool isPrefetch) {
+	MSHR *mshr = &table[0];
+	for (size_t i = 1; i != table.size(); ++i)
+		if (table[i].ready < mshr->ready) mshr = &table[i];
+	double start = max(now, mshr->ready);
+	if (!isPrefetch && start > now) {
+		++mshr_stalls;
+		now = start;
+	}
+	// DRAM latency overlaps with other fills, only the final block transfer is serialized on the bus
+	double xfer = (1ULL << block_bits) / bandwidth;
+	double ready = transfer(start + MISS_PENALTY - xfer, 1ULL << block_bits);
+	mshr->block = block;
+	mshr->ready = ready;
+	mshr->isPrefetch = isPrefetch;
+	return ready;
+}
+
+void MemModel::access(char rw, uint64_t address, const cache_access_t &result, const vector<uint64_t> &prefetched) {
+	const uint64_t block = address >> block_bits;
+	++accesses;
+	now += hit_time;
+
+	// block is still on its way: merge with the outstanding fill
+	MSHR *pending = inFlight(block);
+	if (pending) {
+		if (result.vc_misses) ++merged_misses;
+		else if (pending->isPrefetch) ++late_prefetches;
+		pending->isPrefetch = false;
+		if (rw == READ) now = max(now, pending->ready);
+	}
+	// miss in L1 and VC: fetch from main memory (unless the write went around the cache)
+	else if (result.vc_misses && !result.write_bypasses) {
+		double ready = fill(block, false);
+		if (rw == READ) now = ready;
+	}
+
+	// writebacks are posted, they only consume bandwidth
+	for (int i = 0; i != result.writebacks; ++i) transfer(now, 1ULL << block_bits);
+
+	// prefetches never stall the core
+	for (size_t i = 0; i != prefetched.size(); ++i)
+		if (!inFlight(prefetched[i])) fill(prefetched[i], true);
+}
+
+void MemModel::post(uint64_t bytes) {
+	if (bytes) transfer(now, bytes);
+}
+
+void MemModel::complete(cache_stats_t *p_stats) {
+	p_stats->mshr_stalls = mshr_stalls;
+	p_stats->merged_misses = merged_misses;
+	p_stats->late_prefetches = late_prefetches;
+	p_stats->effective_aat = accesses ? now / accesses : 0;
+	double elapsed = max(now, bus_free);
+	p_stats->bus_utilization = elapsed > 0 ? bus_busy / elapsed : 0;
+}
@@ -0,0 +1,63 @@
+#ifndef MEMMODEL_HPP
+#define MEMMODEL_HPP
+
+#include <cinttypes>
+
+#include <vector>
+
+#include "cachesim.hpp"
+
+using std::vector;
+
+// cycle-approximate timing model of the memory back end behind the cache
+// event-driven: instead of ticking every cycle, the core clock jumps to the completion time of whatever it waits on
+// - the core issues one access per hit time, a read miss blocks it until the fill arrives, a write miss does not
+// - every fill (demand or prefetch) holds an MSHR until it completes, a demand miss stalls when none is free
+// - every block moved to/from memory (fills, prefetches, writebacks) occupies the bus for block size / bandwidth cycles,
+//   stores drained from the write buffer occupy it for the bytes they write
+// - an access to a block whose fill is still in flight merges into that MSHR and waits for it
+// - only the blocks the prefetcher fetched from memory are filled, targets it found in L1 or the VC cost nothing
+class MemModel {
+public:
+	MemModel() : mshrs(0), bandwidth(DEFAULT_BANDWIDTH), block_bits(0), hit_time(0) { reset(0, 0); }
+	// set the back end parameters, 0 MSHRs disables the model
+	void configure(uint64_t mshrs, double bandwidth);
+	// clear all timing state for a new cache configuration, parameters are kept
+	void reset(uint64_t b, double hit_time);
+	bool enabled() const { return mshrs != 0; }
+	double getHitTime() const { return hit_time; } // read-only
+	double clock() const { return now; } // core cycle
+	// the core waits until the given cycle, for a full write buffer
+	void wait(double until) { if (until > now) now = until; }
+	// advance the model by one trace event, result is what the cache did for it and prefetched the block addresses
+	// the prefetcher fetched from memory meanwhile (CacheEngine::setPrefetchLog)
+	void access(char rw, uint64_t address, const cache_access_t &result, const vector<uint64_t> &prefetched);
+	// bytes drained from the write buffer, posted like writebacks
+	void post(uint64_t bytes);
+	// fill in effective AAT and bus utilization
+	void complete(cache_stats_t *p_stats);
+private:
+	// struct for miss status holding register, tracks one block fill
+	struct MSHR {
+		uint64_t block;
+		double ready; // cycle at which the fill completes, the MSHR is free afterwards
+		bool isPrefetch; // not yet touched by a demand access
+		MSHR() : block(0), ready(0), isPrefetch(false) {}
+	};
+	MSHR *inFlight(uint64_t block); // MSHR holding an outstanding fill of block, NULL if none
+	double fill(uint64_t block, bool isPrefetch); // issue a fill, returns its completion time
+	double transfer(double start, uint64_t bytes); // occupy the bus, returns the end of the transfer
+
+	uint64_t mshrs;
+	double bandwidth; // bytes per cycle
+	uint64_t block_bits;
+	double hit_time;
+	vector<MSHR> table;
+	double now; // core clock
+	double bus_free; // cycle at which the bus is idle again
+	double bus_busy; // total cycles the bus spent transferring
+	uint64_t accesses;
+	uint64_t mshr_stalls, merged_misses, late_prefetches;
+};
+
+#endif /* MEMMODEL_HPP */
@@ -0,0 +1,234 @@
+#include "multicore.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// reusable barrier for the quantum synchronization
+class Barrier {
+public:
+	explicit Barrier(size_t count) : count(count), waiting(0), generation(0) {}
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		uint64_t gen = generation;
+		if (++waiting == count) {
+			waiting = 0;
+			++generation;
+			cv.notify_all();
+		}
+		else {
+			while (gen == generation) cv.wait(lock);
+		}
+	}
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t count, waiting;
+	uint64_t generation;
+};
+
+MultiCoreSim::MultiCoreSim(const vector<FILE *> &traces, uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k,
+	uint64_t l2_c, uint64_t l2_s, uint64_t quantum, uint64_t threads) : b(b), quantum(quantum), cores(traces.size()),
+	l2(new_cache_engine(l2_c, b, l2_s, 0, 0)), finished(false) {
+	for (size_t i = 0; i != cores.size(); ++i) {
+		cores[i].l1 = new_cache_engine(c, b, s, v, k);
+		cores[i].l1->setPrefetchLog(&cores[i].prefetched);
+		cores[i].trace = traces[i];
+		cores[i].done = false;
+		cores[i].clock = 0;
+		memset(&cores[i].stats, 0, sizeof(cache_stats_t));
+		cores[i].next = 0;
+	}
+	memset(&l2_stats, 0, sizeof(cache_stats_t));
+	// never more threads than cores
+	this->threads = threads && threads < cores.size() ? threads : cores.size();
+	barrier = new Barrier(this->threads);
+}
+
+MultiCoreSim::~MultiCoreSim() {
+	for (size_t i = 0; i != cores.size(); ++i) delete cores[i].l1;
+	delete l2;
+	delete barrier;
+}
+
+void MultiCoreSim::run() {
+	vector<std::thread> workers;
+	for (size_t t = 1; t < threads; ++t) workers.push_back(std::thread(&MultiCoreSim::worker, this, t));
+	worker(0);
+	for (size_t t = 0; t != workers.size(); ++t) workers[t].join();
+
+	for (size_t i = 0; i != cores.size(); ++i)
+		compute_statistics(cores[i].l1->getB(), cores[i].l1->getS(), &cores[i].stats);
+	compute_statistics(l2->getB(), l2->getS(), &l2_stats);
+}
+
+// thread t simulates cores t, t + threads, ...; thread 0 also resolves the directory requests
+void MultiCoreSim::worker(size_t thread) {
+	while (true) {
+		for (size_t i = thread; i < cores.size(); i += threads)
+			if (!cores[i].done) runQuantum(cores[i]);
+		barrier->wait();
+		if (thread == 0) {
+			resolve();
+			finished = true;
+			for (size_t i = 0; i != cores.size(); ++i) finished = finished && cores[i].done;
+		}
+		barrier->wait();
+		if (finished) return;
+	}
+}
+
+void MultiCoreSim::runQuantum(Core &core) {
+	core.requests.clear();
+	core.next = 0;
+	char rw;
+	uint64_t address;
+	for (uint64_t n = 0; n != quantum; ) {
+		if (feof(core.trace)) {
+			core.done = true;
+			break;
+		}
+		int ret = fscanf(core.trace, "%c %" PRIx64 "\n", &rw, &address);
+		if (ret == 2) {
+			access(core, rw, address);
+			++n;
+		}
+	}
+}
+
+// bit of the word accessed within its block, blocks wider than 64 words share bits
+uint64_t MultiCoreSim::wordMask(uint64_t address) const {
+	return 1ULL << ((address & ((1ULL << b) - 1)) / WORD_BYTES % 64);
+}
+
+void MultiCoreSim::access(Core &core, char rw, uint64_t address) {
+	++core.clock;
+	cache_access_t result = core.l1->cacheAccess(rw, address);
+	record_access(rw, result, &core.stats);
+
+	const uint64_t block = address >> b;
+	bool miss = result.vc_misses != 0;
+	// the word history of a block starts over when it is fetched
+	if (miss) core.touched[block] = wordMask(address);
+	else core.touched[block] |= wordMask(address);
+	// a block that had to be fetched again was evicted in the meantime, whatever E/M copy the core had is gone
+	if (miss) core.exclusive.erase(block);
+
+	// misses fetch the block, writes need it in E or M
+	if (miss || (rw == WRITE && !core.exclusive.count(block)))
+		core.requests.push_back(Request(core.clock, address, rw, miss, false));
+
+	// prefetched blocks are fetched as shared copies, targets the prefetcher found in L1 or VC are not fetched
+	for (size_t i = 0; i != core.prefetched.size(); ++i) {
+		core.exclusive.erase(core.prefetched[i]);
+		core.requests.push_back(Request(core.clock, core.prefetched[i] << b, READ, true, true));
+	}
+	core.prefetched.clear();
+}
+
+// merge the request queues of all cores by timestamp, ties go to the lower core
+void MultiCoreSim::resolve() {
+	while (true) {
+		size_t first = cores.size();
+		for (size_t i = 0; i != cores.size(); ++i) {
+			const Core &core = cores[i];
+			if (core.next == core.requests.size()) continue;
+			if (first == cores.size() || core.requests[core.next].time < cores[first].requests[cores[first].next].time)
+				first = i;
+		}
+		if (first == cores.size()) return;
+		Core &core = cores[first];
+		resolve(first, core.requests[core.next++]);
+	}
+}
+
+void MultiCoreSim::resolve(size_t i, const Request &req) {
+	Core &core = cores[i];
+	const uint64_t block = req.address >> b;
+	const uint64_t self = 1ULL << i;
+	DirEntry &entry = directory[block];
+
+	// block fill: count coherence misses and fetch through the shared L2
+	if (req.miss) {
+		if (!req.prefetch && (entry.invalidated & self)) ++core.coherence.coherence_misses;
+		entry.invalidated &= ~self;
+		record_access(READ, l2->cacheAccess(READ, req.address), &l2_stats);
+	}
+
+	// drop sharers that evicted the block silently
+	for (size_t j = 0; j != cores.size(); ++j) {
+		if (j == i || !(entry.sharers & (1ULL << j))) continue;
+		if (!cores[j].l1->contains(req.address)) {
+			entry.sharers &= ~(1ULL << j);
+			if (entry.owner == (int)j) entry.owner = NO_OWNER;
+			cores[j].exclusive.erase(block);
+		}
+	}
+
+	// read: the owner (M/E -> S) shares the block, the reader gets E if nobody else has it
+	if (req.rw == READ) {
+		if (entry.owner != NO_OWNER && entry.owner != (int)i) {
+			Core &owner = cores[entry.owner];
+			++owner.coherence.downgrades;
+			if (owner.l1->clean(req.address)) ++owner.coherence.coherence_writebacks;
+			owner.exclusive.erase(block);
+			entry.owner = NO_OWNER;
+		}
+		entry.sharers |= self;
+		if (entry.sharers == self) {
+			entry.owner = i;
+			core.exclusive.insert(block);
+		}
+		else if (entry.owner != (int)i) {
+			core.exclusive.erase(block);
+		}
+	}
+
+	// write: invalidate every other copy, the writer gets M
+	else {
+		// a write hit is an upgrade only if the core still holds the block in S: requests queued behind the fill
+		// that made it the E/M owner find the block owned, requests queued behind an invalidation find it gone
+		if (!req.miss && (entry.sharers & self) && entry.owner != (int)i) ++core.coherence.upgrades;
+		const uint64_t word = wordMask(req.address);
+		for (size_t j = 0; j != cores.size(); ++j) {
+			if (j == i || !(entry.sharers & (1ULL << j))) continue;
+			Core &other = cores[j];
+			if (other.l1->invalidate(req.address)) ++other.coherence.coherence_writebacks;
+			++other.coherence.invalidations;
+			++entry.invalidations;
+			// false sharing: the other core never touched the word being written
+			unordered_map<uint64_t, uint64_t>::iterator words = other.touched.find(block);
+			if (words == other.touched.end() || !(words->second & word)) {
+				++other.coherence.false_sharing;
+				++entry.false_sharing;
+			}
+			if (words != other.touched.end()) other.touched.erase(words);
+			other.exclusive.erase(block);
+			entry.invalidated |= 1ULL << j;
+		}
+		entry.sharers = self;
+		entry.owner = i;
+		core.exclusive.insert(block);
+	}
+}
+
+static bool moreFalseSharing(const hotspot_t &x, const hotspot_t &y) {
+	if (x.false_sharing != y.false_sharing) return x.false_sharing > y.false_sharing;
+	if (x.invalidations != y.invalidations) return x.invalidations > y.invalidations;
+	return x.block < y.block;
+}
+
+vector<hotspot_t> MultiCoreSim::getHotspots(size_t n) const {
+	vector<hotspot_t> hotspots;
+	for (unordered_map<uint64_t, DirEntry>::const_iterator it = directory.begin(); it != directory.end(); ++it) {
+		if (!it->second.false_sharing) continue;
+		hotspot_t hotspot = { it->first, it->second.invalidations, it->second.false_sharing };
+		hotspots.push_back(hotspot);
+	}
+	std::sort(hotspots.begin(), hotspots.end(), moreFalseSharing);
+	if (hotspots.size() > n) hotspots.resize(n);
+	return hotspots;
+}
@@ -0,0 +1,124 @@
+#ifndef MULTICORE_HPP
+#define MULTICORE_HPP
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "cachesim.hpp"
+
+using std::vector;
+using std::unordered_map;
+using std::unordered_set;
+
+class Barrier;
+
+// coherence statistics of one core
+struct coherence_stats_t {
+	uint64_t invalidations; // blocks this core lost to another core's write
+	uint64_t false_sharing; // ... of which the writer stored to a word this core never touched
+	uint64_t coherence_misses; // misses on blocks this core lost to an invalidation
+	uint64_t upgrades; // write hits on shared blocks (S -> M)
+	uint64_t downgrades; // M/E blocks this core had to share after another core's read
+	uint64_t coherence_writebacks; // dirty blocks written back because of an invalidation or downgrade
+	coherence_stats_t() : invalidations(0), false_sharing(0), coherence_misses(0), upgrades(0), downgrades(0),
+		coherence_writebacks(0) {}
+};
+
+// block with coherence traffic, for the false-sharing report
+struct hotspot_t {
+	uint64_t block; // block address (byte address >> B)
+	uint64_t invalidations;
+	uint64_t false_sharing;
+};
+
+// multi-core simulation: one trace per core, each core has a private L1 (any CacheEngine) and all cores share an L2
+// L1s are kept coherent with MESI through a directory that tracks sharers and the E/M owner of each block
+//
+// cores run in parallel for a quantum of accesses against their own L1, queuing every access that needs the
+// directory (L1 misses and writes to blocks not held exclusively); at the end of the quantum all threads meet at a
+// barrier and one of them resolves the queued requests in timestamp order, invalidating and downgrading the other
+// L1s and accessing the L2. The quantum bounds how long a core may run on a stale copy, and the results do not
+// depend on the number of threads.
+//
+// evictions are silent: the directory drops stale sharers when it finds the block gone. The L2 sees block fills
+// (demand misses and prefetches) only.
+class MultiCoreSim {
+public:
+	MultiCoreSim(const vector<FILE *> &traces, uint64_t c, uint64_t b, uint64_t s, uint64_t v, uint64_t k,
+		uint64_t l2_c, uint64_t l2_s, uint64_t quantum, uint64_t threads);
+	~MultiCoreSim();
+	void run(); // simulate all traces to the end
+	// per-core results, statistics are complete after run()
+	size_t getCores() const { return cores.size(); }
+	cache_stats_t *getStats(size_t core) { return &cores[core].stats; }
+	const coherence_stats_t &getCoherence(size_t core) const { return cores[core].coherence; }
+	cache_stats_t *getL2Stats() { return &l2_stats; }
+	vector<hotspot_t> getHotspots(size_t n) const; // the n blocks with the most false sharing
+private:
+	MultiCoreSim(const MultiCoreSim &);
+	MultiCoreSim &operator=(const MultiCoreSim &);
+
+	// access that needs the directory, time is the core's access count
+	struct Request {
+		uint64_t time;
+		uint64_t address;
+		char rw;
+		bool miss; // missed L1 and VC, the block is fetched
+		bool prefetch; // fetched by the prefetcher
+		Request(uint64_t time, uint64_t address, char rw, bool miss, bool prefetch) : time(time), address(address),
+			rw(rw), miss(miss), prefetch(prefetch) {}
+	};
+	// struct for one core, touched only by its own thread while a quantum runs
+	struct Core {
+		CacheEngine *l1;
+		FILE *trace;
+		bool done;
+		uint64_t clock; // # accesses issued
+		cache_stats_t stats;
+		coherence_stats_t coherence;
+		unordered_map<uint64_t, uint64_t> touched; // block -> mask of words accessed since the block was fetched
+		unordered_set<uint64_t> exclusive; // blocks held in E or M, writes to them need no directory
+		vector<Request> requests; // queued in the current quantum
+		vector<uint64_t> prefetched; // blocks the L1 prefetcher fetched from memory in the current access
+		size_t next; // next request to resolve
+	};
+	static const int NO_OWNER = -1;
+	// directory entry for one block
+	struct DirEntry {
+		uint64_t sharers; // bit i set when core i may hold the block
+		int owner; // core holding the block in E or M, NO_OWNER if none
+		uint64_t invalidated; // bit i set when core i lost the block to an invalidation and has not missed on it yet
+		uint64_t invalidations;
+		uint64_t false_sharing;
+		DirEntry() : sharers(0), owner(NO_OWNER), invalidated(0), invalidations(0), false_sharing(0) {}
+	};
+
+	void worker(size_t thread);
+	void runQuantum(Core &core);
+	void access(Core &core, char rw, uint64_t address);
+	void resolve(); // resolve all queued requests, single-threaded
+	void resolve(size_t i, const Request &req);
+	uint64_t wordMask(uint64_t address) const;
+
+	uint64_t b;
+	uint64_t quantum;
+	size_t threads;
+	vector<Core> cores;
+	CacheEngine *l2;
+	cache_stats_t l2_stats;
+	unordered_map<uint64_t, DirEntry> directory;
+	bool finished;
+	Barrier *barrier;
+};
+
+static const uint64_t DEFAULT_L2_C = 20;	/* 1MB shared L2 */
+static const uint64_t DEFAULT_L2_S = 4;	/* 16 blocks per set */
+static const uint64_t DEFAULT_QUANTUM = 1000;	/* accesses per core between synchronizations */
+static const uint64_t MAX_CORES = 64;
+static const size_t   HOTSPOTS = 10;	/* false-sharing blocks reported */
+
+#endif /* MULTICORE_HPP */
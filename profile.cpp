@@ -0,0 +1,171 @@
+#include "profile.hpp"
+
+#ifdef CACHESIM_PROFILE
+
+#include <cstdio>
+#include <cstring>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using std::vector;
+
+typedef std::chrono::steady_clock profile_clock;
+
+static const char *PHASE_NAMES[PHASES] = { "Ingest", "Simulate", "Report" };
+static const char *PROBE_NAMES[PROBES] = { "L1", "VC", "Prefetch L1", "Prefetch VC" };
+// bucket 0 holds lookups that compared nothing, bucket i > 0 holds lengths in [2^(i-1), 2^i)
+static const int BUCKETS = 65;
+
+// probe histograms of one thread, merged into the totals when the thread ends
+struct ProbeCounts {
+	uint64_t lookups[PROBES];
+	uint64_t entries[PROBES]; // total entries compared
+	uint64_t max[PROBES];
+	uint64_t buckets[PROBES][BUCKETS];
+	uint64_t fast_hits; // same-block hits that skipped the lookup
+	ProbeCounts() { clear(); }
+	~ProbeCounts();
+	void clear() {
+		memset(lookups, 0, sizeof(lookups));
+		memset(entries, 0, sizeof(entries));
+		memset(max, 0, sizeof(max));
+		memset(buckets, 0, sizeof(buckets));
+		fast_hits = 0;
+	}
+	void add(const ProbeCounts &other) {
+		for (int kind = 0; kind != PROBES; ++kind) {
+			lookups[kind] += other.lookups[kind];
+			entries[kind] += other.entries[kind];
+			if (other.max[kind] > max[kind]) max[kind] = other.max[kind];
+			for (int i = 0; i != BUCKETS; ++i) buckets[kind][i] += other.buckets[kind][i];
+		}
+		fast_hits += other.fast_hits;
+	}
+};
+
+static std::mutex totalsMutex;
+static ProbeCounts totals;
+static thread_local ProbeCounts probeCounts;
+
+ProbeCounts::~ProbeCounts() {
+	if (this == &totals) return;
+	std::lock_guard<std::mutex> lock(totalsMutex);
+	totals.add(*this);
+}
+
+// phase timers, driven by the main thread
+static double phaseTime[PHASES];
+static vector<profile_phase_t> phaseStack;
+static profile_clock::time_point phaseMark;
+
+// charge the time since the last mark to the innermost phase
+static void charge() {
+	profile_clock::time_point now = profile_clock::now();
+	if (!phaseStack.empty())
+		phaseTime[phaseStack.back()] += std::chrono::duration<double>(now - phaseMark).count();
+	phaseMark = now;
+}
+
+// hardware counters of the process, -1 if unavailable
+enum { HW_CYCLES, HW_INSTRUCTIONS, HW_LLC_MISSES, HW_COUNTERS };
+static const char *HW_NAMES[HW_COUNTERS] = { "Cycles", "Instructions", "LLC misses" };
+static int hwFd[HW_COUNTERS] = { -1, -1, -1 };
+
+static int open_counter(uint64_t config) {
+#ifdef __linux__
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	// count the worker threads of the multi-threaded simulators too
+	attr.inherit = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	(void)config;
+	return -1;
+#endif
+}
+
+void profile_start() {
+	hwFd[HW_CYCLES] = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+	hwFd[HW_INSTRUCTIONS] = open_counter(PERF_COUNT_HW_INSTRUCTIONS);
+	hwFd[HW_LLC_MISSES] = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+	phaseMark = profile_clock::now();
+}
+
+void profile_enter(profile_phase_t phase) {
+	charge();
+	phaseStack.push_back(phase);
+}
+
+void profile_leave() {
+	charge();
+	if (!phaseStack.empty()) phaseStack.pop_back();
+}
+
+void profile_probe(int kind, uint64_t length) {
+	if (kind >= PROBES) return;
+	ProbeCounts &counts = probeCounts;
+	++counts.lookups[kind];
+	counts.entries[kind] += length;
+	if (length > counts.max[kind]) counts.max[kind] = length;
+	int bucket = 0;
+	while (length) {
+		++bucket;
+		length >>= 1;
+	}
+	++counts.buckets[kind][bucket];
+}
+
+void profile_fast_hit() {
+	++probeCounts.fast_hits;
+}
+
+void print_profile() {
+	charge();
+	ProbeCounts all;
+	{
+		std::lock_guard<std::mutex> lock(totalsMutex);
+		all.add(totals);
+	}
+	all.add(probeCounts);
+
+	printf("\nProfile\n");
+	for (int phase = 0; phase != PHASES; ++phase) printf("%s time (s): %f\n", PHASE_NAMES[phase], phaseTime[phase]);
+	if (all.fast_hits) printf("Fast path hits: %" PRIu64 "\n", all.fast_hits);
+	for (int kind = 0; kind != PROBES; ++kind) {
+		if (!all.lookups[kind]) continue;
+		printf("%s probes: %" PRIu64 " lookups, %f entries on average, %" PRIu64 " at most\n", PROBE_NAMES[kind],
+			all.lookups[kind], (double)all.entries[kind] / all.lookups[kind], all.max[kind]);
+		for (int i = 0; i != BUCKETS; ++i) {
+			if (!all.buckets[kind][i]) continue;
+			if (i <= 1) printf("  %d: %" PRIu64 "\n", i, all.buckets[kind][i]);
+			else printf("  %" PRIu64 "-%" PRIu64 ": %" PRIu64 "\n", (uint64_t)1 << (i - 1), ((uint64_t)1 << (i - 1)) * 2 - 1,
+				all.buckets[kind][i]);
+		}
+	}
+
+	uint64_t hw[HW_COUNTERS];
+	for (int i = 0; i != HW_COUNTERS; ++i) {
+		if (hwFd[i] < 0 || read(hwFd[i], &hw[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+			printf("%s: unavailable\n", HW_NAMES[i]);
+			continue;
+		}
+		printf("%s: %" PRIu64 "\n", HW_NAMES[i], hw[i]);
+	}
+	if (hwFd[HW_CYCLES] >= 0 && hwFd[HW_INSTRUCTIONS] >= 0 && hw[HW_CYCLES])
+		printf("IPC: %f\n", (double)hw[HW_INSTRUCTIONS] / hw[HW_CYCLES]);
+}
+
+#endif /* CACHESIM_PROFILE */
@@ -0,0 +1,49 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cinttypes>
+
+// self-profiling of the simulator, compiled in with -DCACHESIM_PROFILE (make PROFILE=1) and out otherwise
+//
+// phases: wall time per driver phase; entering a phase pauses the enclosing one, so each phase gets its own time
+// probes: histograms of the entries compared per lookup in L1 sets, the victim cache and the prefetcher's lookups,
+//   0 is a lookup in an empty set or chain; hits of the same-block fast path compare nothing and are counted apart.
+//   Counts are kept per thread and merged when a thread ends, so the multi-threaded simulators report all engines
+// hardware: cycles, instructions and LLC misses of the whole process from perf_event_open (Linux, when permitted)
+
+enum profile_phase_t { PHASE_INGEST, PHASE_SIMULATE, PHASE_REPORT, PHASES };
+enum profile_probe_t { PROBE_L1, PROBE_VC, PROBE_PREFETCH_L1, PROBE_PREFETCH_VC, PROBES, PROBE_NONE = PROBES };
+
+#ifdef CACHESIM_PROFILE
+
+void profile_start(); // start the clock and the hardware counters
+void profile_enter(profile_phase_t phase);
+void profile_leave();
+void profile_probe(int kind, uint64_t length);
+void profile_fast_hit();
+void print_profile();
+
+#define PROFILE_START()				profile_start()
+#define PROFILE_ENTER(phase)		profile_enter(phase)
+#define PROFILE_LEAVE()				profile_leave()
+#define PROFILE_PRINT()				print_profile()
+// probe length counting: declare a counter, count compared entries, record the lookup
+#define PROFILE_COUNTER(length)		uint64_t length = 0
+#define PROFILE_COUNT(length)		++length
+#define PROFILE_PROBE(kind, length)	profile_probe(kind, length)
+#define PROFILE_FAST_HIT()			profile_fast_hit()
+
+#else
+
+#define PROFILE_START()				((void)0)
+#define PROFILE_ENTER(phase)		((void)0)
+#define PROFILE_LEAVE()				((void)0)
+#define PROFILE_PRINT()				((void)0)
+#define PROFILE_COUNTER(length)		((void)0)
+#define PROFILE_COUNT(length)		((void)0)
+#define PROFILE_PROBE(kind, length)	((void)0)
+#define PROFILE_FAST_HIT()			((void)0)
+
+#endif /* CACHESIM_PROFILE */
+
+#endif /* PROFILE_HPP */
@@ -0,0 +1,372 @@
+#include "server.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+TraceServer::TraceServer(const string &socket_path, const vector<string> &fifos, size_t buffer_chunks) :
+	socket_path(socket_path), fifos(fifos), buffer_chunks(buffer_chunks ? buffer_chunks : 1), streams(0),
+	stopping(false), fifo_readers(0) {}
+
+TraceServer::~TraceServer() {
+	reap(true);
+}
+
+bool TraceServer::run() {
+	// set up every listener before serving anything
+	int listen_fd = -1;
+	if (!socket_path.empty()) {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(addr.sun_path)) return false;
+		strcpy(addr.sun_path, socket_path.c_str());
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listen_fd < 0) return false;
+		unlink(socket_path.c_str());
+		if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+			close(listen_fd);
+			return false;
+		}
+	}
+	for (size_t i = 0; i != fifos.size(); ++i) {
+		if (mkfifo(fifos[i].c_str(), 0666) != 0 && errno != EEXIST) {
+			if (listen_fd >= 0) close(listen_fd);
+			return false;
+		}
+	}
+
+	vector<std::thread> readers;
+	fifo_readers = fifos.size();
+	for (size_t i = 0; i != fifos.size(); ++i) readers.push_back(std::thread(&TraceServer::fifoLoop, this, fifos[i]));
+	if (listen_fd >= 0) {
+		acceptLoop(listen_fd);
+		close(listen_fd);
+		unlink(socket_path.c_str());
+	}
+	else {
+		while (!stopping) poll(NULL, 0, POLL_MS);
+	}
+	// readers waiting in open() for a writer only return once one shows up, open and close every pipe until they
+	// have all seen stopping
+	while (fifo_readers) {
+		for (size_t i = 0; i != fifos.size(); ++i) {
+			int fd = open(fifos[i].c_str(), O_WRONLY | O_NONBLOCK);
+			if (fd >= 0) close(fd);
+		}
+		poll(NULL, 0, 1);
+	}
+	for (size_t i = 0; i != readers.size(); ++i) readers[i].join();
+	reap(true);
+	return true;
+}
+
+// wakes up every POLL_MS to join finished sessions, so an idle server holds no finished threads or buffers
+void TraceServer::acceptLoop(int listen_fd) {
+	while (!stopping) {
+		reap(false);
+		pollfd ready = { listen_fd, POLLIN, 0 };
+		int n = poll(&ready, 1, POLL_MS);
+		if (n < 0 && errno != EINTR) return;
+		if (n <= 0) continue;
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			return;
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "socket-%" PRIu64, ++streams);
+		Session *session = new Session;
+		session->finished = false;
+		session->thread = std::thread(&TraceServer::connection, this, session, string(name), fd);
+		sessions.push_back(session);
+	}
+}
+
+void TraceServer::connection(Session *session, string name, int fd) {
+	serve(name, fd, fd);
+	close(fd);
+	session->finished = true;
+}
+
+// a named pipe reaches end of file when its writer closes it, open() then waits for the next writer
+void TraceServer::fifoLoop(string path) {
+	while (!stopping) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (stopping) {
+			close(fd);
+			break;
+		}
+		++streams;
+		serve(path, fd, -1);
+		close(fd);
+	}
+	--fifo_readers;
+}
+
+void TraceServer::reap(bool all) {
+	for (size_t i = 0; i != sessions.size(); ) {
+		if (all || sessions[i]->finished) {
+			sessions[i]->thread.join();
+			delete sessions[i];
+			sessions[i] = sessions.back();
+			sessions.pop_back();
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+void TraceServer::serve(string name, int in_fd, int out_fd) {
+	Stream stream;
+	stream.name = name;
+	stream.in_fd = in_fd;
+	stream.out_fd = out_fd;
+	stream.sim = NULL;
+	stream.eof = false;
+
+	string rest;
+	if (!readHeader(stream, rest)) {
+		if (stream.sim) cachesim_destroy(stream.sim);
+		if (!stopping) send(stream, "error expected header \"C B S V K text|binary [W E R [M D]]\"\n");
+		return;
+	}
+
+	std::thread simulator(&TraceServer::simulate, this, &stream);
+	parse(stream, rest.data(), rest.data() + rest.size());
+	push(stream);
+	vector<char> buffer(READ_BYTES);
+	while (true) {
+		ssize_t n = receive(in_fd, &buffer[0], buffer.size());
+		if (n <= 0) break;
+		parse(stream, &buffer[0], &buffer[0] + n);
+		push(stream);
+	}
+	// the last text line may lack its newline
+	if (!stream.binary && !stream.partial.empty()) {
+		parseLine(stream, stream.partial.data(), stream.partial.data() + stream.partial.size());
+		push(stream);
+	}
+	{
+		std::lock_guard<std::mutex> lock(stream.mutex);
+		stream.eof = true;
+		stream.cv.notify_all();
+	}
+	simulator.join();
+	cachesim_destroy(stream.sim);
+}
+
+// waits at most POLL_MS at a time so that stop() is noticed on idle streams
+ssize_t TraceServer::receive(int fd, char *buffer, size_t size) {
+	while (!stopping) {
+		pollfd ready = { fd, POLLIN, 0 };
+		int n = poll(&ready, 1, POLL_MS);
+		if (n < 0 && errno != EINTR) return -1;
+		if (n <= 0) continue;
+		ssize_t got = read(fd, buffer, size);
+		if (got < 0 && errno == EINTR) continue;
+		return got;
+	}
+	return 0;
+}
+
+bool TraceServer::readHeader(Stream &stream, string &rest) {
+	char buffer[256];
+	size_t used = 0;
+	char *newline = NULL;
+	while (!newline) {
+		if (used == sizeof(buffer) - 1) return false;
+		ssize_t n = receive(stream.in_fd, buffer + used, sizeof(buffer) - 1 - used);
+		if (n <= 0) return false;
+		newline = (char *)memchr(buffer + used, '\n', n);
+		used += n;
+	}
+	rest.assign(newline + 1, buffer + used);
+	*newline = '\0';
+
+	// the optional fields default as the options of cachesim do
+	uint64_t c, b, s, v, k;
+	char format[16];
+	int w = DEFAULT_W;
+	uint64_t e = DEFAULT_WB_ENTRIES, r = DEFAULT_WB_DRAIN, m = DEFAULT_MSHRS;
+	double d = DEFAULT_BANDWIDTH;
+	int fields = sscanf(buffer, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %15s %d %" SCNu64
+		" %" SCNu64 " %" SCNu64 " %lf", &c, &b, &s, &v, &k, format, &w, &e, &r, &m, &d);
+	if (fields != 6 && fields != 9 && fields != 11) return false;
+	if (!strcmp(format, "binary")) stream.binary = true;
+	else if (!strcmp(format, "text")) stream.binary = false;
+	else return false;
+	stream.sim = cachesim_create(c, b, s, v, k);
+	if (!stream.sim) return false;
+	if (cachesim_set_write_policy(stream.sim, w, e, r) != 0) return false;
+	if (cachesim_set_memory(stream.sim, m, d) != 0) return false;
+	return true;
+}
+
+void TraceServer::parse(Stream &stream, const char *p, const char *end) {
+	if (stream.binary) {
+		while (p != end) {
+			// record split across reads
+			if (!stream.partial.empty() || end - p < (ptrdiff_t)BINARY_RECORD) {
+				size_t take = std::min(BINARY_RECORD - stream.partial.size(), (size_t)(end - p));
+				stream.partial.append(p, take);
+				p += take;
+				if (stream.partial.size() != BINARY_RECORD) continue;
+				parseRecord(stream, stream.partial.data());
+				stream.partial.clear();
+				continue;
+			}
+			parseRecord(stream, p);
+			p += BINARY_RECORD;
+		}
+		return;
+	}
+
+	while (p != end) {
+		const char *newline = (const char *)memchr(p, '\n', end - p);
+		if (!newline) {
+			stream.partial.append(p, end);
+			return;
+		}
+		if (stream.partial.empty()) {
+			parseLine(stream, p, newline);
+		}
+		else {
+			stream.partial.append(p, newline);
+			parseLine(stream, stream.partial.data(), stream.partial.data() + stream.partial.size());
+			stream.partial.clear();
+		}
+		p = newline + 1;
+	}
+}
+
+// type byte and little-endian address, records of unknown type are skipped
+void TraceServer::parseRecord(Stream &stream, const char *bytes) {
+	char rw = bytes[0];
+	if (rw != READ && rw != WRITE && rw != '?') return;
+	uint64_t address = 0;
+	for (size_t i = BINARY_RECORD - 1; i != 0; --i) address = address << 8 | (unsigned char)bytes[i];
+	stream.chunk.push(rw, address);
+}
+
+// "r 7fffe8a8", "w 0x1000" or "?", malformed lines are skipped like fscanf does in the drivers
+void TraceServer::parseLine(Stream &stream, const char *p, const char *end) {
+	while (p != end && isspace((unsigned char)*p)) ++p;
+	if (p == end) return;
+	char rw = *p++;
+	uint64_t address = 0;
+	if (rw == '?') {
+		stream.chunk.push(rw, address);
+		return;
+	}
+	if (rw != READ && rw != WRITE) return;
+	while (p != end && isspace((unsigned char)*p)) ++p;
+	if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+	bool digits = false;
+	for (; p != end && isxdigit((unsigned char)*p); ++p) {
+		address = address << 4 | (uint64_t)(isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+		digits = true;
+	}
+	if (digits) stream.chunk.push(rw, address);
+}
+
+void TraceServer::push(Stream &stream) {
+	if (stream.chunk.empty()) return;
+	std::unique_lock<std::mutex> lock(stream.mutex);
+	// backpressure: stop reading until the simulator catches up
+	while (stream.queue.size() >= buffer_chunks) stream.cv.wait(lock);
+	stream.queue.push_back(Chunk());
+	stream.queue.back().swap(stream.chunk);
+	if (!stream.spare.empty()) {
+		stream.chunk.swap(stream.spare.back());
+		stream.spare.pop_back();
+	}
+	stream.cv.notify_all();
+}
+
+void TraceServer::simulate(Stream *stream) {
+	Chunk chunk;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(stream->mutex);
+			if (!chunk.empty()) {
+				chunk.clear();
+				stream->spare.push_back(Chunk());
+				stream->spare.back().swap(chunk);
+			}
+			while (stream->queue.empty() && !stream->eof) stream->cv.wait(lock);
+			if (stream->queue.empty()) break;
+			chunk.swap(stream->queue.front());
+			stream->queue.pop_front();
+			stream->cv.notify_all();
+		}
+		// the accesses between snapshot requests go to the simulator as one batch
+		size_t n = chunk.rw.size(), start = 0;
+		for (size_t i = 0; i <= n; ++i) {
+			if (i != n && chunk.rw[i] != '?') continue;
+			if (i != start) cachesim_access_batch(stream->sim, &chunk.rw[start], &chunk.address[start], i - start);
+			if (i != n) publish(*stream, "snapshot");
+			start = i + 1;
+		}
+	}
+	publish(*stream, "end");
+}
+
+void TraceServer::publish(Stream &stream, const char *event) {
+	cache_stats_t snapshot;
+	// a simulation that ran out of memory has no statistics to report
+	if (cachesim_snapshot(stream.sim, &snapshot, sizeof(snapshot)) != 0) {
+		send(stream, "error out of memory\n");
+		return;
+	}
+	// no accesses yet: report zeros rather than the 0/0 miss rate
+	if (!snapshot.accesses) memset(&snapshot, 0, sizeof(snapshot));
+	char line[2048];
+	snprintf(line, sizeof(line), "stats stream=%s event=%s accesses=%" PRIu64 " reads=%" PRIu64
+		" read_misses=%" PRIu64 " read_misses_combined=%" PRIu64 " writes=%" PRIu64 " write_misses=%" PRIu64
+		" write_misses_combined=%" PRIu64 " misses=%" PRIu64 " write_backs=%" PRIu64 " vc_misses=%" PRIu64
+		" prefetched_blocks=%" PRIu64 " useful_prefetches=%" PRIu64 " bytes_transferred=%" PRIu64
+		" hit_time=%f miss_penalty=%" PRIu64 " miss_rate=%f avg_access_time=%f mshr_stalls=%" PRIu64
+		" merged_misses=%" PRIu64 " late_prefetches=%" PRIu64 " effective_aat=%f bus_utilization=%f"
+		" write_bypasses=%" PRIu64 " write_buffer_stalls=%" PRIu64 " write_buffer_bytes=%" PRIu64
+		" bytes_saved=%" PRIu64 "\n",
+		stream.name.c_str(), event, snapshot.accesses, snapshot.reads, snapshot.read_misses,
+		snapshot.read_misses_combined, snapshot.writes, snapshot.write_misses, snapshot.write_misses_combined,
+		snapshot.misses, snapshot.write_backs, snapshot.vc_misses, snapshot.prefetched_blocks,
+		snapshot.useful_prefetches, snapshot.bytes_transferred, snapshot.hit_time, snapshot.miss_penalty,
+		snapshot.miss_rate, snapshot.avg_access_time, snapshot.mshr_stalls, snapshot.merged_misses,
+		snapshot.late_prefetches, snapshot.effective_aat, snapshot.bus_utilization, snapshot.write_bypasses,
+		snapshot.write_buffer_stalls, snapshot.write_buffer_bytes, snapshot.bytes_saved);
+	send(stream, line);
+}
+
+// back over the socket, or to stdout for named pipes; a client that went away is not an error
+void TraceServer::send(Stream &stream, const string &line) {
+	if (stream.out_fd < 0) {
+		std::lock_guard<std::mutex> lock(output);
+		fputs(line.c_str(), stdout);
+		fflush(stdout);
+		return;
+	}
+	size_t sent = 0;
+	while (sent != line.size()) {
+		ssize_t n = ::send(stream.out_fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return;
+		sent += n;
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cachesim.hpp"
+#include "libcachesim.h"
+
+using std::deque;
+using std::string;
+using std::vector;
+
+// streaming server: simulates live traces sent over a Unix-domain socket or named pipes, no trace files on disk
+//
+// a stream starts with the header line "C B S V K FORMAT [W E R [M D]]", FORMAT is text or binary, followed by
+// trace records; the optional fields select the write policy, write buffer entries and drain interval, MSHRs and
+// DRAM bandwidth as the -w -e -r -m -d options of cachesim do
+//   text:   one "r address" or "w address" per line, as in trace files
+//   binary: 9 bytes per record, the type byte ('r' or 'w') followed by the address as 64-bit little-endian
+// a record of type '?' (text: the line "?", binary: '?' and 8 ignored bytes) requests a snapshot of the statistics
+// at that point of the stream. Snapshots and the final statistics at the end of the stream are one text line
+// "stats name=value ..."; they are sent back over the socket, or printed to stdout for named pipes (one way only).
+//
+// every stream has its own libcachesim handle. The thread that reads the stream parses each read into a chunk and
+// hands it to the simulator thread through a bounded queue; when the simulator falls behind the queue fills up,
+// the reader stops reading and the full kernel buffer blocks the writer.
+//
+// sockets accept any number of concurrent streams, a named pipe carries one stream at a time and is reopened for
+// the next writer when a stream ends. stop() ends streams in progress as if their writers had closed them, closes
+// and removes the socket and makes run() return. POSIX only.
+class TraceServer {
+public:
+	TraceServer(const string &socket_path, const vector<string> &fifos, size_t buffer_chunks);
+	~TraceServer();
+	bool run(); // serve until stop(), false if the listeners cannot be set up
+	void stop() { stopping = true; } // safe to call from a signal handler
+private:
+	TraceServer(const TraceServer &);
+	TraceServer &operator=(const TraceServer &);
+
+	// records of one read, in the layout cachesim_access_batch takes
+	struct Chunk {
+		vector<char> rw;
+		vector<uint64_t> address;
+		bool empty() const { return rw.empty(); }
+		void clear() {
+			rw.clear();
+			address.clear();
+		}
+		void push(char type, uint64_t addr) {
+			rw.push_back(type);
+			address.push_back(addr);
+		}
+		void swap(Chunk &other) {
+			rw.swap(other.rw);
+			address.swap(other.address);
+		}
+	};
+	// struct for one trace stream, shared by its reader and simulator threads
+	struct Stream {
+		string name;
+		int in_fd, out_fd; // out_fd is -1 for named pipes
+		cachesim_t *sim;
+		bool binary;
+		string partial; // record cut off at the end of the last read
+		Chunk chunk; // records of the current read
+		deque<Chunk> queue; // parsed chunks waiting for the simulator, at most buffer_chunks
+		vector<Chunk> spare; // simulated chunks for reuse
+		bool eof;
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+	// struct for the thread serving one connection
+	struct Session {
+		std::thread thread;
+		std::atomic<bool> finished;
+	};
+
+	static const size_t BINARY_RECORD = 9; // bytes per binary record
+
+	void acceptLoop(int listen_fd);
+	void fifoLoop(string path);
+	void connection(Session *session, string name, int fd);
+	void serve(string name, int in_fd, int out_fd); // whole life of one stream
+	ssize_t receive(int fd, char *buffer, size_t size); // read, 0 at the end of the stream or when stopping
+	bool readHeader(Stream &stream, string &rest); // sets up the simulator, rest gets the bytes after the header
+	void parse(Stream &stream, const char *p, const char *end);
+	void parseRecord(Stream &stream, const char *bytes); // one binary record
+	void parseLine(Stream &stream, const char *p, const char *end); // one text record
+	void send(Stream &stream, const string &line);
+	void push(Stream &stream); // hand the current chunk to the simulator, blocks while the queue is full
+	void simulate(Stream *stream);
+	void publish(Stream &stream, const char *event); // snapshot of the statistics
+	void reap(bool all); // join finished sessions
+
+	string socket_path;
+	vector<string> fifos;
+	size_t buffer_chunks;
+	vector<Session *> sessions;
+	std::atomic<uint64_t> streams; // # streams served, names the socket streams
+	std::atomic<bool> stopping;
+	std::atomic<size_t> fifo_readers; // named pipe threads still running
+	std::mutex output; // serializes stdout
+};
+
+static const size_t   DEFAULT_BUFFER_CHUNKS = 16;	/* reads buffered per stream before backpressure */
+static const size_t   READ_BYTES = 1 << 16;	/* bytes per read from a stream */
+static const int      POLL_MS = 100;	/* how often idle threads reap sessions and check for stop() */
+
+#endif /* SERVER_HPP */
@@ -0,0 +1,122 @@
+#ifndef TEST_HPP
+#define TEST_HPP
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../libcachesim.h"
+
+using std::string;
+using std::vector;
+
+// behavior checks run by make test: each test program prints its failures and exits non-zero if there were any
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		printf("%s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		++failures; \
+	} \
+} while (0)
+
+// exit code of a test program
+static inline int finish_test(const char *name) {
+	if (failures) printf("%s: %d failures\n", name, failures);
+	else printf("%s: ok\n", name);
+	return failures ? 1 : 0;
+}
+
+// deterministic trace that exercises hits, conflict and capacity misses, strided streams for the prefetcher and
+// runs of accesses to one block
+struct test_trace_t {
+	vector<char> rw;
+	vector<uint64_t> address;
+	size_t size() const { return rw.size(); }
+};
+
+static inline uint64_t next_random(uint64_t &state) {
+	// xorshift64
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static inline test_trace_t make_trace(uint64_t seed, size_t n) {
+	test_trace_t trace;
+	uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+	uint64_t address = 0x10000;
+	while (trace.size() < n) {
+		uint64_t r = next_random(state);
+		char rw = (r & 3) == 0 ? 'w' : 'r';
+		switch ((r >> 2) % 5) {
+		case 0: // small working set, mostly hits
+			address = 0x10000 + (next_random(state) & 0xfff);
+			break;
+		case 1: // large footprint, conflict and capacity misses
+			address = 0x400000 + (next_random(state) & 0xfffff);
+			break;
+		case 2: { // strided stream, trains the prefetcher
+			uint64_t stride = 32 << (next_random(state) % 3);
+			bool down = next_random(state) & 1;
+			for (int i = 0; i != 16 && trace.size() < n; ++i) {
+				address = down ? address - stride : address + stride;
+				trace.rw.push_back(rw);
+				trace.address.push_back(address);
+			}
+			continue;
+		}
+		case 3: { // run on one block, partly on one address
+			int count = 1 + next_random(state) % 12;
+			for (int i = 0; i != count && trace.size() < n; ++i) {
+				trace.rw.push_back(rw);
+				trace.address.push_back(i < count / 2 ? address : address + (i & 7));
+			}
+			continue;
+		}
+		default: // near the last address
+			address += next_random(state) % 256;
+			break;
+		}
+		trace.rw.push_back(rw);
+		trace.address.push_back(address);
+	}
+	return trace;
+}
+
+// trace file in the format of the drivers, path is a fresh temporary file
+static inline string write_trace(const test_trace_t &trace) {
+	char path[] = "/tmp/cachesim_test_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) return string();
+	FILE *fout = fdopen(fd, "w");
+	for (size_t i = 0; i != trace.size(); ++i) fprintf(fout, "%c %" PRIx64 "\n", trace.rw[i], trace.address[i]);
+	fclose(fout);
+	return path;
+}
+
+static inline bool same_stats(const cache_stats_t &a, const cache_stats_t &b) {
+	return a.accesses == b.accesses && a.reads == b.reads && a.read_misses == b.read_misses &&
+		a.read_misses_combined == b.read_misses_combined && a.writes == b.writes && a.write_misses == b.write_misses &&
+		a.write_misses_combined == b.write_misses_combined && a.misses == b.misses && a.write_backs == b.write_backs &&
+		a.vc_misses == b.vc_misses && a.prefetched_blocks == b.prefetched_blocks &&
+		a.useful_prefetches == b.useful_prefetches && a.bytes_transferred == b.bytes_transferred &&
+		a.hit_time == b.hit_time && a.miss_rate == b.miss_rate && a.miss_penalty == b.miss_penalty &&
+		a.avg_access_time == b.avg_access_time && a.mshr_stalls == b.mshr_stalls &&
+		a.merged_misses == b.merged_misses && a.late_prefetches == b.late_prefetches &&
+		a.effective_aat == b.effective_aat && a.bus_utilization == b.bus_utilization &&
+		a.write_bypasses == b.write_bypasses && a.write_buffer_stalls == b.write_buffer_stalls &&
+		a.write_buffer_bytes == b.write_buffer_bytes && a.bytes_saved == b.bytes_saved;
+}
+
+#endif /* TEST_HPP */
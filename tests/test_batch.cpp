@@ -0,0 +1,66 @@
+#include "test.hpp"
+
+#include "../batch.hpp"
+
+// every (trace, configuration) cell of a batch must equal a single run of that configuration over that trace,
+// whatever the thread count, chunk size and run collapsing
+
+static const size_t TRACES = 3;
+static const size_t TRACE_LENGTH = 30000;
+
+static const batch_config_t CONFIGS[] = {
+	{ 15, 5, 3, 4, 2 },
+	{ 12, 3, 0, 2, 3 },
+	{ 12, 6, 2, 0, 0 },
+	{ 10, 5, 5, 4, 4 }, // hash engine
+	{ 14, 4, 4, 1, 2 }, // hash engine
+};
+
+// the configuration run alone through the C interface
+static cache_stats_t single_run(const test_trace_t &trace, const batch_config_t &config) {
+	cachesim_t *sim = cachesim_create(config.c, config.b, config.s, config.v, config.k);
+	cachesim_access_batch(sim, &trace.rw[0], &trace.address[0], trace.size());
+	cache_stats_t stats;
+	cachesim_snapshot(sim, &stats, sizeof(stats));
+	cachesim_destroy(sim);
+	return stats;
+}
+
+int main() {
+	vector<test_trace_t> traces;
+	vector<string> paths;
+	for (size_t i = 0; i != TRACES; ++i) {
+		traces.push_back(make_trace(20 + i, TRACE_LENGTH));
+		paths.push_back(write_trace(traces.back()));
+	}
+	vector<batch_config_t> configs(CONFIGS, CONFIGS + sizeof(CONFIGS) / sizeof(CONFIGS[0]));
+
+	vector<vector<cache_stats_t> > expected(traces.size());
+	for (size_t j = 0; j != traces.size(); ++j)
+		for (size_t i = 0; i != configs.size(); ++i) expected[j].push_back(single_run(traces[j], configs[i]));
+
+	static const size_t THREADS[] = { 1, 4 };
+	static const size_t CHUNKS[] = { 1000, DEFAULT_CHUNK };
+	for (size_t t = 0; t != sizeof(THREADS) / sizeof(THREADS[0]); ++t)
+		for (size_t chunk = 0; chunk != sizeof(CHUNKS) / sizeof(CHUNKS[0]); ++chunk)
+			for (int collapse = 0; collapse != 2; ++collapse) {
+				BatchSim sim(paths, configs, THREADS[t], CHUNKS[chunk], collapse);
+				CHECK(sim.run(), "batch cannot open its traces");
+				for (size_t j = 0; j != traces.size(); ++j)
+					for (size_t i = 0; i != configs.size(); ++i)
+						CHECK(same_stats(*sim.getStats(j, i), expected[j][i]),
+							"t=%d chunk=%d collapse=%d: trace %d configuration %d differs from a single run",
+							(int)THREADS[t], (int)CHUNKS[chunk], collapse, (int)j, (int)i);
+			}
+
+	// a trace without accesses stays empty
+	vector<string> empty(1, write_trace(test_trace_t()));
+	BatchSim sim(empty, configs, 2, DEFAULT_CHUNK, false);
+	CHECK(sim.run(), "batch cannot open the empty trace");
+	for (size_t i = 0; i != configs.size(); ++i)
+		CHECK(!sim.getStats(0, i)->accesses, "empty trace has accesses for configuration %d", (int)i);
+
+	unlink(empty[0].c_str());
+	for (size_t i = 0; i != paths.size(); ++i) unlink(paths[i].c_str());
+	return finish_test("test_batch");
+}
@@ -0,0 +1,94 @@
+/* smoke test of the C interface: built as C and linked against libcachesim.so, the way a tracer uses it
+**/
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../libcachesim.h"
+
+static int failures = 0;
+
+#define CHECK(cond, message) do { \
+	if (!(cond)) { \
+		printf("%s:%d: %s\n", __FILE__, __LINE__, message); \
+		++failures; \
+	} \
+} while (0)
+
+#define EVENTS 1000
+
+int main(void) {
+	char rw[EVENTS];
+	uint64_t addresses[EVENTS];
+	cache_stats_t single, batch, old;
+	cachesim_t *a, *b;
+	size_t old_size = offsetof(cache_stats_t, mshr_stalls);
+	int i;
+
+	CHECK(cachesim_create(10, 5, 6, 0, 0) == NULL, "sets larger than the cache are accepted");
+	CHECK(cachesim_create(40, 5, 4, 4, 2) == NULL, "hash engine with more than 2^31 blocks is accepted");
+	/* 2^40 victim blocks cannot be allocated, the failure must not escape as a C++ exception */
+	CHECK(cachesim_create(15, 5, 3, (uint64_t)1 << 40, 2) == NULL, "victim cache of 2^40 blocks is accepted");
+
+	a = cachesim_create(15, 5, 3, 4, 2);
+	b = cachesim_create(15, 5, 3, 4, 2);
+	CHECK(a && b, "default configuration is refused");
+	if (!a || !b) return 1;
+	CHECK(cachesim_set_write_policy(a, 4, 8, 4) == -1, "unknown write policy is accepted");
+	CHECK(cachesim_set_write_policy(a, CACHESIM_WRITE_COMBINING, 8, 4) == 0, "write-combining is refused");
+	CHECK(cachesim_set_write_policy(b, CACHESIM_WRITE_COMBINING, 8, 4) == 0, "write-combining is refused");
+	CHECK(cachesim_set_memory(a, 4, 8) == 0 && cachesim_set_memory(b, 4, 8) == 0, "memory model is refused");
+
+	/* strided loads and stores, every fourth event a store */
+	for (i = 0; i != EVENTS; ++i) {
+		rw[i] = i % 4 == 0 ? 'w' : 'r';
+		addresses[i] = 0x10000 + (uint64_t)i * 24;
+	}
+	for (i = 0; i != EVENTS; ++i) cachesim_access(a, rw[i], addresses[i]);
+	CHECK(cachesim_access_batch(b, rw, addresses, EVENTS) == 0, "batch fails");
+	cachesim_snapshot(a, &single, sizeof(single));
+	cachesim_snapshot(b, &batch, sizeof(batch));
+	CHECK(single.accesses == EVENTS && single.writes == EVENTS / 4, "wrong access counts");
+	CHECK(single.misses > 0 && single.misses < EVENTS, "no hits or no misses");
+	CHECK(single.write_buffer_bytes > 0, "write-combining sends no stores to memory");
+	CHECK(single.misses == batch.misses && single.bytes_transferred == batch.bytes_transferred &&
+		single.avg_access_time == batch.avg_access_time && single.effective_aat == batch.effective_aat,
+		"cachesim_access_batch differs from cachesim_access");
+
+	/* a run is the same as its events one by one */
+	cachesim_access_run(a, 'r', 0x900000, 5);
+	for (i = 0; i != 5; ++i) cachesim_access(b, 'r', 0x900000);
+	cachesim_snapshot(a, &single, sizeof(single));
+	cachesim_snapshot(b, &batch, sizeof(batch));
+	CHECK(single.reads == batch.reads && single.read_misses == batch.read_misses,
+		"cachesim_access_run differs from cachesim_access");
+
+	/* an empty run simulates nothing */
+	CHECK(cachesim_access_run(a, 'r', 0x1000, 0) == 0 && cachesim_access_run(a, 'w', 0x2000, 0) == 0,
+		"empty run fails");
+	cachesim_snapshot(a, &batch, sizeof(batch));
+	CHECK(batch.accesses == single.accesses && batch.misses == single.misses, "empty run is simulated");
+
+	/* a caller built against an older header gets its fields only */
+	memset(&old, 0xab, sizeof(old));
+	cachesim_snapshot(a, &old, old_size);
+	CHECK(old.accesses == single.accesses && old.avg_access_time == single.avg_access_time,
+		"short snapshot misses the old fields");
+	CHECK(((unsigned char *)&old)[old_size] == 0xab && ((unsigned char *)&old)[sizeof(old) - 1] == 0xab,
+		"short snapshot writes past the caller's structure");
+
+	/* reset empties the cache and clears the statistics */
+	cachesim_reset(a);
+	cachesim_snapshot(a, &single, sizeof(single));
+	CHECK(single.accesses == 0 && single.misses == 0 && single.write_buffer_bytes == 0, "reset keeps statistics");
+	cachesim_access(a, rw[0], addresses[0]);
+	cachesim_snapshot(a, &single, sizeof(single));
+	CHECK(single.accesses == 1 && single.misses == 1, "reset keeps cached blocks");
+
+	cachesim_destroy(a);
+	cachesim_destroy(b);
+
+	if (failures) printf("test_capi: %d failures\n", failures);
+	else printf("test_capi: ok\n");
+	return failures ? 1 : 0;
+}
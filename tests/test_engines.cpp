@@ -0,0 +1,150 @@
+#include "test.hpp"
+
+#include <set>
+
+#include "../cachesim.hpp"
+
+// the hash-indexed engine must behave exactly like the list engine: same result for every access, same prefetched
+// blocks and the same answers to the coherence hooks, under every write policy
+
+struct engine_config_t {
+	uint64_t c, b, s, v, k;
+};
+
+static const engine_config_t CONFIGS[] = {
+	{ 15, 5, 3, 4, 2 }, // default
+	{ 12, 5, 2, 0, 4 },
+	{ 12, 3, 0, 2, 3 }, // direct mapped
+	{ 10, 4, 1, 8, 1 },
+	{ 15, 6, 0, 0, 2 },
+	{ 13, 5, 3, 1, 0 }, // no prefetcher
+	{ 10, 5, 5, 4, 4 }, // fully associative
+	{ 12, 6, 6, 0, 3 }, // fully associative, no victim cache
+	{ 14, 4, 4, 2, 2 }, // the hash engine's smallest S
+};
+// far larger than the trace: sets are materialized as the trace touches them
+static const engine_config_t LARGE[] = {
+	{ 60, 6, 0, 0, 0 },
+	{ 48, 6, 2, 0, 0 },
+	{ 37, 6, 4, 0, 0 }, // the hash engine's largest cache
+};
+static const size_t TRACE_LENGTH = 200000;
+static const size_t LARGE_TRACE_LENGTH = 2000;
+static const size_t COHERENCE_INTERVAL = 97; // accesses between coherence operations
+
+static bool same_access(const cache_access_t &a, const cache_access_t &b) {
+	return a.misses == b.misses && a.vc_misses == b.vc_misses && a.writebacks == b.writebacks &&
+		a.useful_prefetches == b.useful_prefetches && a.write_bypasses == b.write_bypasses &&
+		a.prefetch_blocks == b.prefetch_blocks && a.prefetch_stride == b.prefetch_stride;
+}
+
+// returns false at the first difference
+static bool compare(const engine_config_t &config, write_policy_t policy, const test_trace_t &trace) {
+	CacheSim list(config.c, config.b, config.s, config.v, config.k);
+	HashCacheSim hash(config.c, config.b, config.s, config.v, config.k);
+	list.setWritePolicy(policy);
+	hash.setWritePolicy(policy);
+	vector<uint64_t> list_log, hash_log;
+	list.setPrefetchLog(&list_log);
+	hash.setPrefetchLog(&hash_log);
+
+	for (size_t i = 0; i != trace.size(); ++i) {
+		cache_access_t a = list.cacheAccess(trace.rw[i], trace.address[i]);
+		cache_access_t b = hash.cacheAccess(trace.rw[i], trace.address[i]);
+		if (!same_access(a, b) || list_log != hash_log) {
+			CHECK(false, "C=%" PRIu64 " B=%" PRIu64 " S=%" PRIu64 " V=%" PRIu64 " K=%" PRIu64
+				" W=%d: access %d differs", config.c, config.b, config.s, config.v, config.k, (int)policy, (int)i);
+			return false;
+		}
+		list_log.clear();
+		hash_log.clear();
+
+		// another core's invalidation, downgrade or directory lookup, on a block touched earlier
+		if (i % COHERENCE_INTERVAL == 0) {
+			uint64_t address = trace.address[(i * 31) % trace.size()];
+			bool x, y;
+			const char *operation;
+			switch (i / COHERENCE_INTERVAL % 3) {
+			case 0:
+				operation = "invalidate";
+				x = list.invalidate(address);
+				y = hash.invalidate(address);
+				break;
+			case 1:
+				operation = "clean";
+				x = list.clean(address);
+				y = hash.clean(address);
+				break;
+			default:
+				operation = "contains";
+				x = list.contains(address);
+				y = hash.contains(address);
+				break;
+			}
+			if (x != y) {
+				CHECK(false, "C=%" PRIu64 " B=%" PRIu64 " S=%" PRIu64 " V=%" PRIu64 " K=%" PRIu64
+					" W=%d: %s after access %d differs", config.c, config.b, config.s, config.v, config.k, (int)policy,
+					operation, (int)i);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main() {
+	test_trace_t trace = make_trace(1, TRACE_LENGTH);
+	for (size_t i = 0; i != sizeof(CONFIGS) / sizeof(CONFIGS[0]); ++i)
+		for (int policy = WRITE_BACK; policy <= WRITE_COMBINING; ++policy)
+			compare(CONFIGS[i], (write_policy_t)policy, trace);
+
+	// reconfiguring an engine must leave nothing of the previous cache behind
+	CacheSim list(10, 5, 5, 4, 4);
+	HashCacheSim hash(10, 5, 5, 4, 4);
+	for (size_t i = 0; i != trace.size(); ++i) {
+		list.cacheAccess(trace.rw[i], trace.address[i]);
+		hash.cacheAccess(trace.rw[i], trace.address[i]);
+	}
+	list.configure(12, 5, 4, 2, 2);
+	hash.configure(12, 5, 4, 2, 2);
+	CacheSim fresh(12, 5, 4, 2, 2);
+	for (size_t i = 0; i != trace.size(); ++i) {
+		cache_access_t a = fresh.cacheAccess(trace.rw[i], trace.address[i]);
+		cache_access_t b = list.cacheAccess(trace.rw[i], trace.address[i]);
+		cache_access_t c = hash.cacheAccess(trace.rw[i], trace.address[i]);
+		if (!same_access(a, b) || !same_access(a, c)) {
+			CHECK(false, "reconfigured engine differs from a new one at access %d", (int)i);
+			break;
+		}
+	}
+
+	// nothing is ever evicted from a large nominal cache, each block misses once
+	std::set<uint64_t> blocks;
+	for (size_t i = 0; i != LARGE_TRACE_LENGTH; ++i) blocks.insert(trace.address[i] >> 6);
+	for (size_t i = 0; i != sizeof(LARGE) / sizeof(LARGE[0]); ++i) {
+		const engine_config_t &config = LARGE[i];
+		CacheEngine *engine = new_cache_engine(config.c, config.b, config.s, config.v, config.k);
+		uint64_t misses = 0;
+		for (size_t j = 0; j != LARGE_TRACE_LENGTH; ++j)
+			misses += engine->cacheAccess(trace.rw[j], trace.address[j]).misses;
+		CHECK(misses == blocks.size(), "C=%" PRIu64 " B=%" PRIu64 " S=%" PRIu64 ": %d misses, expected %d", config.c,
+			config.b, config.s, (int)misses, (int)blocks.size());
+		delete engine;
+	}
+
+	// shrinking a large nominal cache leaves none of its blocks behind
+	list.configure(60, 6, 0, 0, 0);
+	for (size_t i = 0; i != LARGE_TRACE_LENGTH; ++i) list.cacheAccess(trace.rw[i], trace.address[i]);
+	list.configure(12, 5, 4, 2, 2);
+	fresh.configure(12, 5, 4, 2, 2);
+	for (size_t i = 0; i != trace.size(); ++i) {
+		cache_access_t a = fresh.cacheAccess(trace.rw[i], trace.address[i]);
+		cache_access_t b = list.cacheAccess(trace.rw[i], trace.address[i]);
+		if (!same_access(a, b)) {
+			CHECK(false, "engine shrunk from a large cache differs from a new one at access %d", (int)i);
+			break;
+		}
+	}
+
+	return finish_test("test_engines");
+}
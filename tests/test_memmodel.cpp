@@ -0,0 +1,60 @@
+#include "test.hpp"
+
+#include "../cachesim.hpp"
+
+// the memory model fills only what the cache fetched: prefetch targets already in L1 or the VC take no MSHR and
+// no bus time, so a later hit on them is neither a late prefetch nor a stall; a full write buffer holds the core
+
+static const uint64_t MSHRS = 4;
+
+static cache_stats_t read_blocks(const uint64_t *blocks, size_t n) {
+	cachesim_t *sim = cachesim_create(DEFAULT_C, DEFAULT_B, DEFAULT_S, DEFAULT_V, DEFAULT_K);
+	cachesim_set_memory(sim, MSHRS, DEFAULT_BANDWIDTH);
+	for (size_t i = 0; i != n; ++i) cachesim_access(sim, READ, blocks[i] << DEFAULT_B);
+	cache_stats_t stats;
+	cachesim_snapshot(sim, &stats, sizeof(stats));
+	cachesim_destroy(sim);
+	return stats;
+}
+
+// write-combining stores to distinct blocks, each takes a write buffer entry
+static cache_stats_t store_blocks(uint64_t entries, uint64_t drain_interval, size_t n) {
+	cachesim_t *sim = cachesim_create(DEFAULT_C, DEFAULT_B, DEFAULT_S, DEFAULT_V, DEFAULT_K);
+	cachesim_set_write_policy(sim, CACHESIM_WRITE_COMBINING, entries, drain_interval);
+	cachesim_set_memory(sim, 8, DEFAULT_BANDWIDTH);
+	for (size_t i = 0; i != n; ++i) cachesim_access(sim, WRITE, (uint64_t)i << DEFAULT_B);
+	cache_stats_t stats;
+	cachesim_snapshot(sim, &stats, sizeof(stats));
+	cachesim_destroy(sim);
+	return stats;
+}
+
+int main() {
+	// the misses on 10, 11, 12 train the prefetcher on stride 1 with 13 and 14 already resident
+	static const uint64_t RESIDENT[] = { 13, 14, 10, 11, 12, 13, 14 };
+	cache_stats_t stats = read_blocks(RESIDENT, sizeof(RESIDENT) / sizeof(RESIDENT[0]));
+	CHECK(stats.prefetched_blocks == 2, "%d prefetched blocks, expected 2", (int)stats.prefetched_blocks);
+	CHECK(!stats.late_prefetches && !stats.mshr_stalls, "resident prefetch targets: %d late prefetches, %d stalls",
+		(int)stats.late_prefetches, (int)stats.mshr_stalls);
+	// five serialized demand misses, the two hits wait for nothing
+	double expected = (5 * (MISS_PENALTY + stats.hit_time) + 2 * stats.hit_time) / stats.accesses;
+	CHECK(stats.effective_aat < expected + 1, "resident prefetch targets: effective AAT %f, expected about %f",
+		stats.effective_aat, expected);
+
+	// the same pattern without the early reads: 13 and 14 are fetched and the hit on 13 waits for its fill
+	static const uint64_t FETCHED[] = { 10, 11, 12, 13, 14 };
+	stats = read_blocks(FETCHED, sizeof(FETCHED) / sizeof(FETCHED[0]));
+	CHECK(stats.late_prefetches, "hit on a prefetch in flight is not late");
+
+	// a buffer that keeps up costs nothing, one that drains an entry every 1000 access slots makes every store wait
+	static const size_t STORES = 20000;
+	cache_stats_t fast = store_blocks(64, 1, STORES), slow = store_blocks(1, 1000, STORES);
+	CHECK(!fast.write_buffer_stalls && fast.effective_aat < fast.hit_time + 0.01,
+		"write buffer that keeps up: %d stalls, effective AAT %f", (int)fast.write_buffer_stalls, fast.effective_aat);
+	CHECK(slow.write_buffer_stalls == STORES - 1, "%d write buffer stalls, expected %d", (int)slow.write_buffer_stalls,
+		(int)STORES - 1);
+	CHECK(slow.effective_aat > 999 * slow.hit_time, "write buffer stalls do not slow the core: effective AAT %f",
+		slow.effective_aat);
+
+	return finish_test("test_memmodel");
+}
@@ -0,0 +1,122 @@
+#include "test.hpp"
+
+#include "../multicore.hpp"
+
+// the worker threads only split the cores between them: every thread count must give the same results, and a core
+// that shares nothing with another one sees no coherence traffic
+
+static const size_t CORES = 4;
+static const size_t TRACE_LENGTH = 50000;
+
+struct mc_result_t {
+	vector<cache_stats_t> stats;
+	vector<coherence_stats_t> coherence;
+	cache_stats_t l2;
+	vector<hotspot_t> hotspots;
+};
+
+static mc_result_t simulate(const vector<string> &paths, uint64_t quantum, uint64_t threads) {
+	vector<FILE *> traces;
+	for (size_t i = 0; i != paths.size(); ++i) traces.push_back(fopen(paths[i].c_str(), "r"));
+	MultiCoreSim sim(traces, DEFAULT_C, DEFAULT_B, DEFAULT_S, DEFAULT_V, DEFAULT_K, DEFAULT_L2_C, DEFAULT_L2_S, quantum,
+		threads);
+	sim.run();
+	mc_result_t result;
+	for (size_t i = 0; i != sim.getCores(); ++i) {
+		result.stats.push_back(*sim.getStats(i));
+		result.coherence.push_back(sim.getCoherence(i));
+	}
+	result.l2 = *sim.getL2Stats();
+	result.hotspots = sim.getHotspots(HOTSPOTS);
+	for (size_t i = 0; i != traces.size(); ++i) fclose(traces[i]);
+	return result;
+}
+
+static bool same_coherence(const coherence_stats_t &a, const coherence_stats_t &b) {
+	return a.invalidations == b.invalidations && a.false_sharing == b.false_sharing &&
+		a.coherence_misses == b.coherence_misses && a.upgrades == b.upgrades && a.downgrades == b.downgrades &&
+		a.coherence_writebacks == b.coherence_writebacks;
+}
+
+static void compare(const mc_result_t &a, const mc_result_t &b, uint64_t quantum, uint64_t threads) {
+	for (size_t i = 0; i != a.stats.size(); ++i) {
+		CHECK(same_stats(a.stats[i], b.stats[i]), "q=%d t=%d: core %d statistics differ from t=1", (int)quantum,
+			(int)threads, (int)i);
+		CHECK(same_coherence(a.coherence[i], b.coherence[i]), "q=%d t=%d: core %d coherence differs from t=1",
+			(int)quantum, (int)threads, (int)i);
+	}
+	CHECK(same_stats(a.l2, b.l2), "q=%d t=%d: L2 statistics differ from t=1", (int)quantum, (int)threads);
+	bool hotspots = a.hotspots.size() == b.hotspots.size();
+	for (size_t i = 0; hotspots && i != a.hotspots.size(); ++i)
+		hotspots = a.hotspots[i].block == b.hotspots[i].block &&
+			a.hotspots[i].invalidations == b.hotspots[i].invalidations &&
+			a.hotspots[i].false_sharing == b.hotspots[i].false_sharing;
+	CHECK(hotspots, "q=%d t=%d: false sharing hotspots differ from t=1", (int)quantum, (int)threads);
+}
+
+// trace of the given records
+static string write_records(const char *rw, const uint64_t *address, size_t n) {
+	test_trace_t trace;
+	trace.rw.assign(rw, rw + n);
+	trace.address.assign(address, address + n);
+	return write_trace(trace);
+}
+
+int main() {
+	// the traces overlap in their small working set, so the cores share and steal blocks
+	vector<string> paths;
+	for (size_t i = 0; i != CORES; ++i) paths.push_back(write_trace(make_trace(10 + i, TRACE_LENGTH)));
+
+	static const uint64_t QUANTA[] = { 1, 64, DEFAULT_QUANTUM };
+	for (size_t i = 0; i != sizeof(QUANTA) / sizeof(QUANTA[0]); ++i) {
+		mc_result_t serial = simulate(paths, QUANTA[i], 1);
+		coherence_stats_t total;
+		for (size_t j = 0; j != serial.coherence.size(); ++j) {
+			total.invalidations += serial.coherence[j].invalidations;
+			total.upgrades += serial.coherence[j].upgrades;
+			// an upgrade is a write hit on a shared block
+			CHECK(serial.coherence[j].upgrades <= serial.stats[j].writes - serial.stats[j].write_misses,
+				"q=%d: core %d has more upgrades than write hits", (int)QUANTA[i], (int)j);
+		}
+		CHECK(total.invalidations && total.upgrades, "q=%d: the shared traces cause no coherence traffic",
+			(int)QUANTA[i]);
+		for (uint64_t threads = 2; threads <= CORES; ++threads)
+			compare(serial, simulate(paths, QUANTA[i], threads), QUANTA[i], threads);
+		compare(serial, simulate(paths, QUANTA[i], 0), QUANTA[i], 0);
+	}
+
+	// a single core has nobody to share with
+	vector<string> one(1, paths[0]);
+	mc_result_t alone = simulate(one, DEFAULT_QUANTUM, 1);
+	const coherence_stats_t &coherence = alone.coherence[0];
+	CHECK(!coherence.invalidations && !coherence.coherence_misses && !coherence.upgrades && !coherence.downgrades &&
+		!coherence.coherence_writebacks, "a single core sees coherence traffic");
+
+	// both cores read A, then core 0 writes it: one upgrade on core 0, one invalidation on core 1
+	static const uint64_t A = 0x1000;
+	static const char SHARED_RW0[] = { 'r', 'r', 'w' }, SHARED_RW1[] = { 'r', 'r', 'r' };
+	static const uint64_t SHARED_ADDRESS0[] = { A, 0x2000, A }, SHARED_ADDRESS1[] = { A, 0x3000, 0x4000 };
+	vector<string> shared;
+	shared.push_back(write_records(SHARED_RW0, SHARED_ADDRESS0, 3));
+	shared.push_back(write_records(SHARED_RW1, SHARED_ADDRESS1, 3));
+	mc_result_t upgrade = simulate(shared, DEFAULT_QUANTUM, 1);
+	CHECK(upgrade.coherence[0].upgrades == 1 && upgrade.coherence[1].invalidations == 1,
+		"write to a shared block: %d upgrades, %d invalidations, expected 1 and 1",
+		(int)upgrade.coherence[0].upgrades, (int)upgrade.coherence[1].invalidations);
+
+	// core 1 writes A between core 0's read and write: core 0 lost A before its write, which is no upgrade
+	static const char STOLEN_RW0[] = { 'r', 'r', 'w' }, STOLEN_RW1[] = { 'r', 'w', 'r' };
+	static const uint64_t STOLEN_ADDRESS0[] = { A, 0x2000, A }, STOLEN_ADDRESS1[] = { 0x3000, A, 0x4000 };
+	vector<string> stolen;
+	stolen.push_back(write_records(STOLEN_RW0, STOLEN_ADDRESS0, 3));
+	stolen.push_back(write_records(STOLEN_RW1, STOLEN_ADDRESS1, 3));
+	mc_result_t lost = simulate(stolen, DEFAULT_QUANTUM, 1);
+	CHECK(lost.coherence[0].upgrades == 0 && lost.coherence[0].invalidations == 1,
+		"write to an invalidated block: %d upgrades, %d invalidations, expected 0 and 1",
+		(int)lost.coherence[0].upgrades, (int)lost.coherence[0].invalidations);
+
+	for (size_t i = 0; i != shared.size(); ++i) unlink(shared[i].c_str());
+	for (size_t i = 0; i != stolen.size(); ++i) unlink(stolen[i].c_str());
+	for (size_t i = 0; i != paths.size(); ++i) unlink(paths[i].c_str());
+	return finish_test("test_multicore");
+}
@@ -0,0 +1,97 @@
+#include "test.hpp"
+
+#include "../cachesim.hpp"
+
+// cachesim -l collapses consecutive events of the same type to the same block (the same address when the write
+// buffer tracks words) into runs; simulating the runs must give the statistics of simulating every event
+
+static const size_t TRACE_LENGTH = 100000;
+
+struct run_config_t {
+	uint64_t c, b, s, v, k;
+	uint64_t mshrs;
+};
+
+static const run_config_t CONFIGS[] = {
+	{ 15, 5, 3, 4, 2, 0 },
+	{ 12, 3, 0, 2, 3, 0 },
+	{ 10, 5, 5, 4, 4, 0 }, // hash engine
+	{ 15, 5, 3, 4, 2, 4 }, // memory model
+	{ 14, 4, 4, 1, 2, 8 }, // hash engine and memory model
+};
+
+static cachesim_t *create(const run_config_t &config, int policy, uint64_t entries) {
+	cachesim_t *sim = cachesim_create(config.c, config.b, config.s, config.v, config.k);
+	cachesim_set_memory(sim, config.mshrs, DEFAULT_BANDWIDTH);
+	cachesim_set_write_policy(sim, policy, entries, DEFAULT_WB_DRAIN);
+	return sim;
+}
+
+// the pre-pass of cachesim_driver.cpp
+static void simulate_runs(cachesim_t *sim, const test_trace_t &trace, uint64_t run_shift) {
+	char run_rw = 0;
+	uint64_t run_address = 0;
+	uint64_t run_count = 0;
+	for (size_t i = 0; i != trace.size(); ++i) {
+		if (run_count && trace.rw[i] == run_rw && (trace.address[i] >> run_shift) == (run_address >> run_shift)) {
+			++run_count;
+			continue;
+		}
+		if (run_count) cachesim_access_run(sim, run_rw, run_address, run_count);
+		run_rw = trace.rw[i];
+		run_address = trace.address[i];
+		run_count = 1;
+	}
+	if (run_count) cachesim_access_run(sim, run_rw, run_address, run_count);
+}
+
+// engine_access_run on a bare engine, without write buffer or memory model, against one access per event
+static void compare_engine(CacheEngine &events, CacheEngine &runs, write_policy_t policy, const test_trace_t &trace) {
+	events.setWritePolicy(policy);
+	runs.setWritePolicy(policy);
+	cache_stats_t expected, stats;
+	memset(&expected, 0, sizeof(expected));
+	memset(&stats, 0, sizeof(stats));
+	size_t start = 0;
+	for (size_t i = 1; i <= trace.size(); ++i) {
+		if (i != trace.size() && trace.rw[i] == trace.rw[start] && trace.address[i] == trace.address[start]) continue;
+		for (size_t j = start; j != i; ++j)
+			record_access(trace.rw[j], events.cacheAccess(trace.rw[j], trace.address[j]), &expected);
+		engine_access_run(&runs, trace.rw[start], trace.address[start], i - start, &stats);
+		start = i;
+	}
+	CHECK(same_stats(stats, expected), "S=%" PRIu64 " W=%d: engine runs differ from single events", runs.getS(),
+		(int)policy);
+}
+
+int main() {
+	test_trace_t trace = make_trace(30, TRACE_LENGTH);
+	// 0 write buffer entries: every store goes to memory on its own
+	static const uint64_t ENTRIES[] = { DEFAULT_WB_ENTRIES, 0 };
+	for (size_t i = 0; i != sizeof(CONFIGS) / sizeof(CONFIGS[0]); ++i)
+		for (int policy = CACHESIM_WRITE_BACK; policy <= CACHESIM_WRITE_COMBINING; ++policy)
+			for (size_t e = 0; e != sizeof(ENTRIES) / sizeof(ENTRIES[0]); ++e) {
+				const run_config_t &config = CONFIGS[i];
+				cachesim_t *events = create(config, policy, ENTRIES[e]);
+				for (size_t j = 0; j != trace.size(); ++j) cachesim_access(events, trace.rw[j], trace.address[j]);
+				cachesim_t *runs = create(config, policy, ENTRIES[e]);
+				simulate_runs(runs, trace, policy == CACHESIM_WRITE_BACK ? config.b : 0);
+
+				cache_stats_t expected, stats;
+				cachesim_snapshot(events, &expected, sizeof(expected));
+				cachesim_snapshot(runs, &stats, sizeof(stats));
+				CHECK(same_stats(stats, expected), "C=%" PRIu64 " B=%" PRIu64 " S=%" PRIu64 " M=%" PRIu64
+					" W=%d E=%" PRIu64 ": runs differ from single events", config.c, config.b, config.s, config.mshrs,
+					policy, ENTRIES[e]);
+				cachesim_destroy(events);
+				cachesim_destroy(runs);
+			}
+
+	for (int policy = WRITE_BACK; policy <= WRITE_COMBINING; ++policy) {
+		CacheSim list_events(15, 5, 3, 4, 2), list_runs(15, 5, 3, 4, 2);
+		compare_engine(list_events, list_runs, (write_policy_t)policy, trace);
+		HashCacheSim hash_events(12, 5, 4, 4, 2), hash_runs(12, 5, 4, 4, 2);
+		compare_engine(hash_events, hash_runs, (write_policy_t)policy, trace);
+	}
+	return finish_test("test_runs");
+}
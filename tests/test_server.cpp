@@ -0,0 +1,168 @@
+#include "test.hpp"
+
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "../server.hpp"
+
+// round trip through the streaming server: streams sent over the socket, in text or binary, must come back with the
+// statistics of the same trace simulated directly, and stop() must remove the socket
+
+static const size_t TRACE_LENGTH = 20000;
+static const size_t SNAPSHOT_AT = 5000; // records before the snapshot request
+static const size_t BINARY_RECORD = 9; // type byte and 64-bit address
+
+static int connect_to(const string &path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	// the server thread may not be listening yet
+	for (int attempt = 0; attempt != 100; ++attempt) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) return -1;
+		if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+		close(fd);
+		usleep(20000);
+	}
+	return -1;
+}
+
+// send the whole stream, close the sending side and read every line the server sends back
+static vector<string> round_trip(const string &path, const string &stream) {
+	vector<string> lines;
+	int fd = connect_to(path);
+	if (fd < 0) return lines;
+	size_t sent = 0;
+	while (sent != stream.size()) {
+		ssize_t n = send(fd, stream.data() + sent, stream.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) break;
+		sent += n;
+	}
+	shutdown(fd, SHUT_WR);
+	string received;
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0) received.append(buffer, n);
+	close(fd);
+	for (size_t start = 0, end; (end = received.find('\n', start)) != string::npos; start = end + 1)
+		lines.push_back(received.substr(start, end - start));
+	return lines;
+}
+
+// value of " name=" in a stats line
+static string field(const string &line, const char *name) {
+	string key = string(" ") + name + "=";
+	size_t start = line.find(key);
+	if (start == string::npos) return string();
+	start += key.size();
+	return line.substr(start, line.find(' ', start) - start);
+}
+
+// the fields of a stats line against the statistics of a direct simulation
+static void check_line(const string &line, const char *event, const cache_stats_t &stats, const char *what) {
+	char expected[64];
+	CHECK(field(line, "event") == event, "%s: event %s, expected %s", what, field(line, "event").c_str(), event);
+	static const char *COUNTS[] = { "accesses", "misses", "write_backs", "bytes_transferred", "write_buffer_bytes" };
+	const uint64_t values[] = { stats.accesses, stats.misses, stats.write_backs, stats.bytes_transferred,
+		stats.write_buffer_bytes };
+	for (size_t i = 0; i != sizeof(COUNTS) / sizeof(COUNTS[0]); ++i) {
+		snprintf(expected, sizeof(expected), "%" PRIu64, values[i]);
+		CHECK(field(line, COUNTS[i]) == expected, "%s: %s=%s, expected %s", what, COUNTS[i],
+			field(line, COUNTS[i]).c_str(), expected);
+	}
+	snprintf(expected, sizeof(expected), "%f", stats.avg_access_time);
+	CHECK(field(line, "avg_access_time") == expected, "%s: avg_access_time=%s, expected %s", what,
+		field(line, "avg_access_time").c_str(), expected);
+	snprintf(expected, sizeof(expected), "%f", stats.effective_aat);
+	CHECK(field(line, "effective_aat") == expected, "%s: effective_aat=%s, expected %s", what,
+		field(line, "effective_aat").c_str(), expected);
+}
+
+static void serve(TraceServer *server, bool *started) {
+	*started = server->run();
+}
+
+// header, records and a snapshot request after the first SNAPSHOT_AT records
+static string make_stream(const string &header, const test_trace_t &trace, bool binary) {
+	string stream = header + "\n";
+	for (size_t i = 0; i != trace.size(); ++i) {
+		if (i == SNAPSHOT_AT) stream += binary ? string("?\0\0\0\0\0\0\0\0", BINARY_RECORD) : string("?\n");
+		if (binary) {
+			stream += trace.rw[i];
+			for (int byte = 0; byte != 8; ++byte) stream += (char)(trace.address[i] >> 8 * byte);
+		}
+		else {
+			char line[32];
+			snprintf(line, sizeof(line), "%c %" PRIx64 "\n", trace.rw[i], trace.address[i]);
+			stream += line;
+		}
+	}
+	return stream;
+}
+
+// statistics of the first n records, simulated directly
+static cache_stats_t simulate(const test_trace_t &trace, size_t n, int policy, uint64_t mshrs) {
+	cachesim_t *sim = cachesim_create(DEFAULT_C, DEFAULT_B, DEFAULT_S, DEFAULT_V, DEFAULT_K);
+	cachesim_set_write_policy(sim, policy, DEFAULT_WB_ENTRIES, DEFAULT_WB_DRAIN);
+	cachesim_set_memory(sim, mshrs, DEFAULT_BANDWIDTH);
+	cachesim_access_batch(sim, &trace.rw[0], &trace.address[0], n);
+	cache_stats_t stats;
+	cachesim_snapshot(sim, &stats, sizeof(stats));
+	cachesim_destroy(sim);
+	return stats;
+}
+
+static void check_stream(const string &path, const test_trace_t &trace, bool binary, int policy, uint64_t mshrs) {
+	char header[128];
+	if (policy == CACHESIM_WRITE_BACK && !mshrs)
+		snprintf(header, sizeof(header), "%d %d %d %d %d %s", (int)DEFAULT_C, (int)DEFAULT_B, (int)DEFAULT_S,
+			(int)DEFAULT_V, (int)DEFAULT_K, binary ? "binary" : "text");
+	else
+		snprintf(header, sizeof(header), "%d %d %d %d %d %s %d %d %d %d %f", (int)DEFAULT_C, (int)DEFAULT_B,
+			(int)DEFAULT_S, (int)DEFAULT_V, (int)DEFAULT_K, binary ? "binary" : "text", policy, (int)DEFAULT_WB_ENTRIES,
+			(int)DEFAULT_WB_DRAIN, (int)mshrs, DEFAULT_BANDWIDTH);
+	char what[256];
+	snprintf(what, sizeof(what), "stream \"%s\"", header);
+	vector<string> lines = round_trip(path, make_stream(header, trace, binary));
+	CHECK(lines.size() == 2, "%s: %d lines back, expected 2", what, (int)lines.size());
+	if (lines.size() != 2) return;
+	check_line(lines[0], "snapshot", simulate(trace, SNAPSHOT_AT, policy, mshrs), what);
+	check_line(lines[1], "end", simulate(trace, trace.size(), policy, mshrs), what);
+}
+
+int main() {
+	char directory[] = "/tmp/cachesim_test_XXXXXX";
+	if (!mkdtemp(directory)) {
+		printf("test_server: cannot create a temporary directory\n");
+		return 1;
+	}
+	string path = string(directory) + "/server.sock";
+	TraceServer server(path, vector<string>(), DEFAULT_BUFFER_CHUNKS);
+	bool started = false;
+	std::thread thread(serve, &server, &started);
+
+	test_trace_t trace = make_trace(40, TRACE_LENGTH);
+	check_stream(path, trace, false, CACHESIM_WRITE_BACK, 0);
+	check_stream(path, trace, true, CACHESIM_WRITE_BACK, 0);
+	check_stream(path, trace, false, CACHESIM_WRITE_THROUGH, 4);
+	check_stream(path, trace, true, CACHESIM_WRITE_COMBINING, 0);
+
+	// a bad header is answered with an error
+	vector<string> lines = round_trip(path, "15 5 3 4 2 text 9 8 4\nr 1000\n");
+	CHECK(lines.size() == 1 && lines[0].compare(0, 6, "error ") == 0, "unknown write policy is not refused");
+	lines = round_trip(path, "15 5 3 4 2 text\n");
+	CHECK(lines.size() == 1 && field(lines[0], "accesses") == "0" && field(lines[0], "miss_rate") == "0.000000",
+		"stream without accesses does not report zeros");
+
+	server.stop();
+	thread.join();
+	CHECK(started, "server did not start");
+	struct stat info;
+	CHECK(stat(path.c_str(), &info) != 0, "socket left behind after stop()");
+	rmdir(directory);
+	return finish_test("test_server");
+}
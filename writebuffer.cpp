@@ -0,0 +1,97 @@
+#include "writebuffer.hpp"
+
+void WriteBuffer::configure(bool active, uint64_t entries, uint64_t drain_interval) {
+	this->active = active;
+	this->entries = entries;
+	this->drain_interval = drain_interval;
+	reset(block_bits);
+}
+
+void WriteBuffer::reset(uint64_t b) {
+	block_bits = b;
+	buffer.assign(entries, Entry());
+	head = 0;
+	size = 0;
+	now = 0;
+	next_drain = 0;
+	stalls = 0;
+	bytes = 0;
+	saved = 0;
+}
+
+uint64_t WriteBuffer::drain() {
+	Entry &entry = buffer[head];
+	uint64_t written = 0;
+	for (uint64_t words = entry.words; words; words &= words - 1) written += WORD_BYTES;
+	if (written > (1ULL << block_bits)) written = 1ULL << block_bits;
+	bytes += written;
+	saved += entry.stores * WORD_BYTES - written;
+	head = (head + 1) % entries;
+	--size;
+	return written;
+}
+
+uint64_t WriteBuffer::access(bool store, uint64_t address) {
+	double ready;
+	return access(store, address, now + 1, ready);
+}
+
+uint64_t WriteBuffer::access(bool store, uint64_t address, double time, double &ready) {
+	const double interval = drain_interval * access_time;
+	uint64_t drained = 0;
+	now = time;
+	ready = now;
+	// drain at the modeled rate, the drain clock only runs while there is something to drain
+	while (size && now >= next_drain) {
+		drained += drain();
+		next_drain += interval;
+	}
+	if (!store) return drained;
+
+	// no buffer: the store goes straight to memory
+	if (!entries) {
+		uint64_t written = WORD_BYTES;
+		if (written > (1ULL << block_bits)) written = 1ULL << block_bits;
+		bytes += written;
+		return written;
+	}
+
+	// word offset within the block, blocks wider than 64 words share mask bits
+	const uint64_t block = address >> block_bits;
+	const uint64_t word = (address & ((1ULL << block_bits) - 1)) / WORD_BYTES % 64;
+
+	// coalesce with a pending store to the same block
+	for (uint64_t i = 0; i != size; ++i) {
+		Entry &entry = buffer[(head + i) % entries];
+		if (entry.block == block) {
+			entry.words |= 1ULL << word;
+			++entry.stores;
+			return drained;
+		}
+	}
+
+	// buffer full: stall until the oldest entry has drained
+	if (size == entries) {
+		++stalls;
+		now = next_drain;
+		ready = now;
+		drained += drain();
+		next_drain += interval;
+	}
+	if (!size) next_drain = now + interval;
+	Entry &entry = buffer[(head + size) % entries];
+	entry.block = block;
+	entry.words = 1ULL << word;
+	entry.stores = 1;
+	++size;
+	return drained;
+}
+
+uint64_t WriteBuffer::complete(cache_stats_t *p_stats) {
+	uint64_t drained = 0;
+	while (size) drained += drain();
+	p_stats->write_buffer_stalls = stalls;
+	p_stats->write_buffer_bytes = bytes;
+	p_stats->bytes_saved += saved;
+	return drained;
+}
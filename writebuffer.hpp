@@ -0,0 +1,61 @@
+#ifndef WRITEBUFFER_HPP
+#define WRITEBUFFER_HPP
+
+#include <cinttypes>
+
+#include <vector>
+
+#include "cachesim.hpp"
+
+using std::vector;
+
+// coalescing write buffer between the cache and memory
+// stores sent to memory (write-through, or write misses that were not allocated) enter the buffer; a store to a block
+// that already has an entry is merged into it, otherwise it takes a new entry. The oldest entry drains to memory every
+// drain_interval accesses, writing only the words that were stored. A store that finds the buffer full stalls until
+// the next drain. A buffer of 0 entries writes every store to memory on its own.
+// on its own the buffer keeps time in accesses; behind the memory model it runs on the core clock in cycles, an access
+// slot lasts one hit time and a stall holds the core (see cachesim::access)
+class WriteBuffer {
+public:
+	WriteBuffer() : active(false), entries(0), drain_interval(0), block_bits(0), access_time(1) { reset(0); }
+	// active is false when the write policy never sends stores to memory
+	void configure(bool active, uint64_t entries, uint64_t drain_interval);
+	// clear all entries and counters for a new cache configuration, parameters are kept
+	void reset(uint64_t b);
+	bool enabled() const { return active; }
+	// clock units per access slot, drains are drain_interval slots apart: 1 counting accesses, the hit time in cycles
+	void setAccessTime(double time) { access_time = time; }
+	// advance the buffer by one access, store is true when the access sends a store to memory
+	// returns the bytes drained to memory meanwhile
+	uint64_t access(bool store, uint64_t address);
+	// same on an outside clock: advance to time, ready gets the time the store was taken, later than time when it
+	// waited for a full buffer to drain
+	uint64_t access(bool store, uint64_t address, double time, double &ready);
+	// drain everything that is left and fill in write buffer statistics, returns the bytes drained
+	uint64_t complete(cache_stats_t *p_stats);
+private:
+	// struct for write buffer entry, one block with a mask of the words stored to it
+	struct Entry {
+		uint64_t block;
+		uint64_t words; // bit i set when word i of the block was stored to
+		uint64_t stores; // # stores merged into the entry
+		Entry() : block(0), words(0), stores(0) {}
+	};
+	uint64_t drain(); // write the oldest entry to memory, returns the bytes written
+
+	bool active;
+	uint64_t entries;
+	uint64_t drain_interval;
+	uint64_t block_bits;
+	double access_time;
+	vector<Entry> buffer; // FIFO ring, oldest entry at head
+	uint64_t head, size;
+	double now; // accesses seen plus accesses stalled, or the core cycle behind the memory model
+	double next_drain;
+	uint64_t stalls;
+	uint64_t bytes; // bytes written to memory
+	uint64_t saved; // bytes not written thanks to coalescing
+};
+
+#endif /* WRITEBUFFER_HPP */